@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+//! AppSettings
+/*!
+Options used to configure the app at start up, filled in from the command line arguments
+*/
+struct AppSettings
+{
+	//! Public boolean.
+	/*! True to render into an offscreen colour target without creating a window or swap chain*/
+	bool headless = false;
+	//! Public uint32_t.
+	/*! Number of frames the headless benchmark renders before exiting*/
+	uint32_t benchmarkFrames = 1000;
+	//! Public uint32_t.
+	/*! Number of frames rendered before the benchmark starts recording frame times*/
+	uint32_t warmupFrames = 30;
+	//! Public float.
+	/*! Simulated seconds that pass each frame in headless mode (keeps animation deterministic)*/
+	float fixedTimestep = 1.0f / 60.0f;
+	//! Public uint32_t.
+	/*! Resolution of the window or offscreen colour target*/
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	//! Public uint32_t.
+	/*! Frames between printing the rolling GPU pass times, 0 to never print*/
+	uint32_t gpuReportInterval = 0;
+	//! Public string.
+	/*! File the GPU time of every pass is written to each frame as CSV, empty to disable*/
+	std::string gpuCsvPath;
+	//! Public boolean.
+	/*! True to record the command buffers again every frame on worker threads instead of pre-recording them*/
+	bool recordEachFrame = false;
+	//! Public uint32_t.
+	/*! Number of threads recording draws when recording each frame, 0 for one per hardware thread*/
+	uint32_t recordThreads = 0;
+	//! Public boolean.
+	/*! True to run the subsurface scattering blur as compute dispatches instead of raster passes*/
+	bool computeSubsurface = false;
+	//! Public uint32_t.
+	/*! Number of taps in the subsurface scattering kernel, odd and at most 25 (7, 11, 17 or 25 for the usual quality tiers)*/
+	uint32_t subsurfaceSamples = 25;
+	//! Public uint32_t.
+	/*! Divides the resolution of the raster subsurface blur (1, 2 or 4), above 1 the result is upsampled with a bilateral filter*/
+	uint32_t subsurfaceScale = 1;
+	//! Public uint32_t.
+	/*! Frames the subsurface kernel taps are spread over (1 to 8), above 1 the raster blur accumulates a reprojected history*/
+	uint32_t subsurfaceTemporalPhases = 1;
+	//! Public boolean.
+	/*! True to merge neighbouring subsurface kernel taps into single bilinear fetches (raster blur only)*/
+	bool subsurfaceBilinear = false;
+	//! Public boolean.
+	/*! True to pack the depth into the alpha of a half float GBuffer colour target, so the raster blur reads colour and depth in one fetch*/
+	bool subsurfacePackedDepth = false;
+	//! Public boolean.
+	/*! True to classify the screen into tiles each frame and run the compute blur only on tiles with subsurface pixels, needs computeSubsurface*/
+	bool subsurfaceTiles = false;
+	//! Public boolean.
+	/*! True for the raster subsurface blur to use a smaller kernel (7, 11 or 17 taps) on pixels where the projected kernel is only a few pixels wide*/
+	bool subsurfaceAdaptive = false;
+	//! Public boolean.
+	/*! True to add wax and marble busts (material IDs 1 and 2) either side of the head, so several diffusion profiles are blurred in one frame*/
+	bool subsurfaceProfilesScene = false;
+	//! Public boolean.
+	/*! True to start with the Burley normalized diffusion blur instead of the separable one, B switches between them while running*/
+	bool burleySubsurface = false;
+	//! Public boolean.
+	/*! True to lay down the scene's depth in a position only pre-pass, so the GBuffer pass only shades the visible surface of each pixel*/
+	bool depthPrePass = false;
+	//! Public boolean.
+	/*! True to run the lighting as a second subpass of the GBuffer render pass, reading the resolved GBuffer as input attachments*/
+	bool gbufferSubpasses = false;
+	//! Public uint32_t.
+	/*! Shadow filter, 0 a single tap, 1 a 3x3 grid of depth reads, 2 a Poisson disk and 3 a rotated grid of hardware compared taps*/
+	uint32_t shadowFilter = 1;
+	//! Public uint32_t.
+	/*! Taps in the hardware filtered kernels, up to 16 for the Poisson disk and 4, 9 or 16 for the rotated grid. Each covers 2x2 texels*/
+	uint32_t shadowTaps = 9;
+
+	//! The FromCommandLine function
+	/*!
+	Returns the settings described by the command line arguments, throws if an argument is not recognised
+	\param argc int, number of arguments
+	\param argv char**, argument strings
+	*/
+	static AppSettings FromCommandLine(int argc, char** argv);
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <glfw3.h>
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! CommandRecorder
+/*!
+Worker threads and transient command pools for recording the command buffers again every frame.
+Each frame in flight has a pool per worker thread plus one for the primary buffer, so no pool is ever used by two threads at once.
+A frame's pools are reset together once its fence has signaled, which recycles every buffer allocated from them.
+*/
+class CommandRecorder
+{
+private:
+	//! Private VkDevice.
+	/*! Logical device the pools belong to*/
+	VkDevice m_Device = VK_NULL_HANDLE;
+	//! Private uint32_t.
+	/*! Number of worker threads*/
+	uint32_t m_ThreadCount = 0;
+	//! Private uint32_t.
+	/*! Number of frames in flight*/
+	uint32_t m_FrameCount = 0;
+	//! Private VkCommandPool vector.
+	/*! Pools indexed by frame * (m_ThreadCount + 1) + thread, the last pool of each frame holds the primary buffer*/
+	std::vector<VkCommandPool> m_Pools;
+	//! Private VkCommandBuffer vector.
+	/*! Primary command buffer of each frame*/
+	std::vector<VkCommandBuffer> m_Primaries;
+	//! Private VkCommandBuffer vectors.
+	/*! Secondary command buffers allocated so far from each worker pool, indexed like m_Pools*/
+	std::vector<std::vector<VkCommandBuffer>> m_Secondaries;
+
+	//! Private thread vector.
+	/*! The worker threads*/
+	std::vector<std::thread> m_Threads;
+	//! Private mutex and condition variables.
+	/*! Guard the job state below, workers wait on m_Start and Run waits on m_Done*/
+	std::mutex m_Mutex;
+	std::condition_variable m_Start;
+	std::condition_variable m_Done;
+	//! Private job state.
+	/*! Job being run, how many workers have still to finish it, and a count that changes every time a job is started*/
+	const std::function<void(uint32_t)>* m_Job = nullptr;
+	uint32_t m_Pending = 0;
+	uint64_t m_Generation = 0;
+	bool m_Quit = false;
+	//! Private exception_ptr.
+	/*! First exception thrown by a worker during the current job, rethrown by Run*/
+	std::exception_ptr m_Error;
+
+	//! The workerLoop member function
+	/*!
+	Body of each worker thread, runs every job started by Run until CleanUp is called
+	*/
+	void workerLoop(uint32_t thread);
+	//! The pool member function
+	/*!
+	Returns the pool of a worker thread (or the primary pool when thread is m_ThreadCount) for a frame
+	*/
+	VkCommandPool& pool(uint32_t frame, uint32_t thread) { return m_Pools[frame * (m_ThreadCount + 1) + thread]; }
+
+public:
+	//! The Create member function
+	/*!
+	Create the pools and primary buffers and start the worker threads
+	\param device VkDevice, logical device
+	\param queueFamily uint32_t, queue family the command buffers are submitted to
+	\param threadCount uint32_t, number of worker threads, 0 to use one per hardware thread
+	\param frameCount uint32_t, number of frames that can be in flight
+	*/
+	void Create(VkDevice device, uint32_t queueFamily, uint32_t threadCount, uint32_t frameCount);
+	//! The CleanUp member function
+	/*!
+	Stop the worker threads and destroy the pools, the device must be idle
+	*/
+	void CleanUp();
+
+	//! The ThreadCount member function
+	/*!
+	Returns the number of worker threads, which is also the number of slices a job is split into
+	*/
+	uint32_t ThreadCount() const { return m_ThreadCount; }
+	//! The ResetFrame member function
+	/*!
+	Reset every pool of a frame so its buffers can be recorded again, the frame must not be in flight
+	*/
+	void ResetFrame(uint32_t frame);
+	//! The Primary member function
+	/*!
+	Returns the primary command buffer of a frame
+	*/
+	VkCommandBuffer Primary(uint32_t frame) const { return m_Primaries[frame]; }
+	//! The BeginSecondary member function
+	/*!
+	Returns a secondary command buffer from a worker's pool, begun to continue the given render pass.
+	Must only be called from that worker's thread.
+	\param frame uint32_t, frame in flight being recorded
+	\param thread uint32_t, worker thread index
+	\param index uint32_t, which of the worker's buffers this frame (one per render pass it records into)
+	\param renderPass VkRenderPass, render pass the buffer is executed in
+	\param framebuffer VkFramebuffer, frame buffer the render pass is begun with
+	*/
+	VkCommandBuffer BeginSecondary(uint32_t frame, uint32_t thread, uint32_t index, VkRenderPass renderPass, VkFramebuffer framebuffer);
+	//! The Run member function
+	/*!
+	Runs the job once on every worker thread, passing in the thread index, and returns when they have all finished
+	*/
+	void Run(const std::function<void(uint32_t)>& job);
+};
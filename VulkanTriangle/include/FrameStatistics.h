@@ -0,0 +1,55 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+//! FrameStatistics
+/*!
+Collects frame time samples (in milliseconds) and prints a summary of min/mean/percentile values.
+*/
+class FrameStatistics
+{
+private:
+	//! Private vector of floats.
+	/*! Every sample recorded so far, in milliseconds*/
+	std::vector<float> m_Samples;
+
+	//! The percentile member function
+	/*!
+	Returns the value below which the given fraction of the sorted samples fall
+	\param sorted const std::vector<float>&, samples sorted in ascending order
+	\param fraction float, percentile as a 0-1 value
+	*/
+	static float percentile(const std::vector<float>& sorted, float fraction);
+
+public:
+	//! The reserve member function
+	/*!
+	Allocate enough memory up front so recording a sample never allocates mid benchmark
+	*/
+	void reserve(size_t count) { m_Samples.reserve(count); }
+	//! The record member function
+	/*!
+	Add a sample in milliseconds
+	*/
+	void record(float ms) { m_Samples.push_back(ms); }
+	//! The clear member function
+	/*!
+	Remove all recorded samples
+	*/
+	void clear() { m_Samples.clear(); }
+	//! The count member function
+	/*!
+	Returns the number of recorded samples
+	*/
+	size_t count() const { return m_Samples.size(); }
+
+	//! The report member function
+	/*!
+	Print the sample count, min, mean, p50, p95, p99 and max to the stream
+	\param out std::ostream&, stream to write to
+	\param label const std::string&, name printed at the start of the report
+	*/
+	void report(std::ostream& out, const std::string& label) const;
+};
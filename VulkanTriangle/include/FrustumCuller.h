@@ -0,0 +1,53 @@
+#pragma once
+
+#include <GLM/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+//! FrustumCuller
+/*!
+World space bounds of every object, packed as separate arrays of floats (padded to a multiple of four) so the plane tests can run on four objects at a time with SSE.
+Each object has an axis aligned box and a bounding sphere sharing the same centre, an object is culled if either is fully outside one of the frustum planes.
+*/
+class FrustumCuller
+{
+private:
+	//! Private float vectors.
+	/*! Centre, box half size and sphere radius of each object*/
+	std::vector<float> m_CenterX, m_CenterY, m_CenterZ;
+	std::vector<float> m_ExtentX, m_ExtentY, m_ExtentZ;
+	std::vector<float> m_Radius;
+	//! Private size_t.
+	/*! Number of objects, the arrays are padded past this with empty bounds*/
+	size_t m_Count = 0;
+
+public:
+	//! The Resize member function
+	/*!
+	Set the number of objects, new bounds are empty until SetBounds is called
+	*/
+	void Resize(size_t count);
+	//! The SetBounds member function
+	/*!
+	Set an object's world space bounds
+	\param index size_t, object index
+	\param center vec3, centre of the box and sphere
+	\param extents vec3, half size of the box along each axis
+	\param radius float, radius of the sphere
+	*/
+	void SetBounds(size_t index, glm::vec3 center, glm::vec3 extents, float radius);
+	//! The Cull member function
+	/*!
+	Test every object against the frustum of a view projection matrix (Vulkan clip space, depth 0 to 1)
+	\param viewProj mat4, projection * view
+	\param visible vector, filled with 1 for each object at least partly inside the frustum and 0 otherwise
+	*/
+	void Cull(const glm::mat4& viewProj, std::vector<uint8_t>& visible) const;
+
+	//! The ExtractPlanes function
+	/*!
+	Get the six normalized frustum planes (xyz normal pointing inwards, w distance) from a view projection matrix
+	*/
+	static void ExtractPlanes(const glm::mat4& viewProj, glm::vec4 planes[6]);
+};
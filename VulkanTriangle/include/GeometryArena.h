@@ -0,0 +1,66 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <glfw3.h>
+
+#include <vector>
+
+#include "VulkanObject.h"
+
+class VulkanEngine;
+
+//! GeometryArena
+/*!
+Every mesh packed into one vertex buffer and one index buffer.
+Meshes are added while the objects load, each gets a MeshRange (first index, index count and vertex offset) to draw it with,
+then the whole arena is uploaded once. Draws then never rebind vertex or index buffers, which lets a pass be a single indirect draw.
+*/
+class GeometryArena
+{
+private:
+	//! Private VkDevice.
+	/*! Logical device the buffers belong to*/
+	VkDevice m_Device = VK_NULL_HANDLE;
+	//! Private vectors.
+	/*! Mesh data waiting to be uploaded, cleared by Upload*/
+	std::vector<Vertex> m_Vertices;
+	std::vector<uint32_t> m_Indices;
+
+	//! Private VkBuffer and VkDeviceMemory.
+	/*! Required components for storing vertex infomation */
+	VkBuffer m_VertexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory m_VertexBufferMemory = VK_NULL_HANDLE;
+	//! Private VkBuffer and VkDeviceMemory.
+	/*! Required components for storing vertex indecies */
+	VkBuffer m_IndexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory m_IndexBufferMemory = VK_NULL_HANDLE;
+
+public:
+	//! The Add member function
+	/*!
+	Append a mesh, returns where it sits in the arena, must be called before Upload
+	\param vertices vector, the mesh's vertices
+	\param indices vector, the mesh's indices (relative to its first vertex)
+	*/
+	MeshRange Add(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	//! The Upload member function
+	/*!
+	Create the device local vertex and index buffers holding every mesh added so far
+	\param engine VulkanEngine*, used to create the buffers
+	\param device VkDevice, logical device
+	\param graphicsQueue VkQueue, queue used to copy the data
+	\param commandPool VkCommandPool, pool the copy commands are allocated from
+	*/
+	void Upload(VulkanEngine* engine, VkDevice device, VkQueue graphicsQueue, VkCommandPool commandPool);
+	//! The CleanUp member function
+	/*!
+	Destroy the buffers
+	*/
+	void CleanUp();
+
+	//! The CmdBind member function
+	/*!
+	Bind the vertex and index buffers, every mesh is then drawn using its MeshRange
+	*/
+	void CmdBind(VkCommandBuffer commandBuffer) const;
+};
@@ -0,0 +1,194 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <glfw3.h>
+
+#include <array>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "FrameStatistics.h"
+
+//! GpuPass
+/*!
+The render passes timed by the GpuProfiler, in the order they are recorded
+*/
+enum GpuPass
+{
+	GPU_PASS_CULL,
+	GPU_PASS_SHADOW,
+	GPU_PASS_GBUFFER,
+	GPU_PASS_LIGHTING,
+	GPU_PASS_SSS_HORIZONTAL,
+	GPU_PASS_SSS_VERTICAL,
+	GPU_PASS_COUNT
+};
+
+//! GpuProfiler
+/*!
+Times each render pass on the GPU using a ring of timestamp query sets, one set per command buffer that can be in flight.
+Where pipeline statistics are supported it also counts the fragment shader invocations of the GBuffer pass.
+Results are read back once the fence of the frame that wrote them has signaled, so reading never stalls the CPU.
+*/
+class GpuProfiler
+{
+private:
+	//! Private VkDevice.
+	/*! Logical device the query pool belongs to*/
+	VkDevice m_Device = VK_NULL_HANDLE;
+	//! Private boolean.
+	/*! False if the graphics queue cannot write timestamps, every call is then ignored*/
+	bool m_Supported = false;
+	//! Private VkQueryPool.
+	/*! Holds two timestamps (begin, end) per pass for every set*/
+	VkQueryPool m_QueryPool = VK_NULL_HANDLE;
+	//! Private uint32_t.
+	/*! Number of query sets in the ring*/
+	uint32_t m_SetCount = 0;
+	//! Private float.
+	/*! Nanoseconds per timestamp tick*/
+	float m_TimestampPeriod = 1.0f;
+	//! Private uint64_t.
+	/*! Mask of the valid timestamp bits for the queue*/
+	uint64_t m_TimestampMask = ~0ull;
+	//! Private boolean.
+	/*! True if the GBuffer's fragment shader invocations are counted*/
+	bool m_CountFragments = false;
+	//! Private VkQueryPool.
+	/*! Holds one pipeline statistics query (fragment shader invocations) per set*/
+	VkQueryPool m_StatisticsPool = VK_NULL_HANDLE;
+	//! Private vector of bools.
+	/*! True while a set has been submitted and its results not yet read*/
+	std::vector<bool> m_Pending;
+
+	//! Private constant.
+	/*! Number of frames averaged for the rolling pass times*/
+	static const uint32_t ROLLING_FRAMES = 60;
+	//! Private arrays.
+	/*! Last ROLLING_FRAMES pass times in ms and where the next one is written*/
+	std::array<std::array<float, ROLLING_FRAMES>, GPU_PASS_COUNT> m_History = {};
+	uint32_t m_HistoryHead = 0;
+	uint32_t m_HistoryCount = 0;
+	//! Private FrameStatistics.
+	/*! Every pass time recorded, used for the end of run summary*/
+	std::array<FrameStatistics, GPU_PASS_COUNT> m_Statistics;
+	//! Private fragment counts.
+	/*! Last ROLLING_FRAMES GBuffer fragment shader invocation counts, and the total and frame count since the statistics were cleared*/
+	std::array<uint64_t, ROLLING_FRAMES> m_FragmentHistory = {};
+	uint64_t m_FragmentTotal = 0;
+	uint64_t m_FragmentFrames = 0;
+
+	//! Private uint64_t.
+	/*! Frames read back so far, used to decide when to report*/
+	uint64_t m_FramesCollected = 0;
+	//! Private uint32_t.
+	/*! Frames between reports, 0 to never report*/
+	uint32_t m_ReportInterval = 0;
+	//! Private ofstream.
+	/*! CSV file the periodic reports are also written to (if open)*/
+	std::ofstream m_Csv;
+
+	//! The queryIndex member function
+	/*!
+	Returns the index of the begin (or end) query of a pass in a set
+	*/
+	uint32_t queryIndex(uint32_t set, GpuPass pass, bool end) const { return (set * GPU_PASS_COUNT + pass) * 2 + (end ? 1 : 0); }
+
+public:
+	//! The Create member function
+	/*!
+	Set up the profiler, the queries themselves are created by CreateQueries
+	\param physicalDevice VkPhysicalDevice, used to query the timestamp period
+	\param device VkDevice, logical device
+	\param timestampValidBits uint32_t, valid bits of the queue family that writes the timestamps (0 if unsupported)
+	\param countFragments bool, true to count the GBuffer's fragment shader invocations, needs the pipelineStatisticsQuery feature
+	\param reportInterval uint32_t, frames between console reports, 0 to disable
+	\param csvPath const std::string&, file every frame's pass times are written to, empty to disable
+	*/
+	void Create(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t timestampValidBits, bool countFragments, uint32_t reportInterval, const std::string& csvPath);
+	//! The CreateQueries member function
+	/*!
+	Create the query pool, one set per command buffer that can be submitted
+	*/
+	void CreateQueries(uint32_t setCount);
+	//! The DestroyQueries member function
+	/*!
+	Destroy the query pool, any results not read back are dropped
+	*/
+	void DestroyQueries();
+	//! The CleanUp member function
+	/*!
+	Destroys the query pool and closes the CSV file
+	*/
+	void CleanUp();
+
+	//! The Enabled member function
+	/*!
+	Returns true if timestamps are supported and being recorded
+	*/
+	bool Enabled() const { return m_Supported && m_QueryPool != VK_NULL_HANDLE; }
+
+	//! The CmdReset member function
+	/*!
+	Records the reset of a query set, must be recorded outside of a render pass before the set is written
+	*/
+	void CmdReset(VkCommandBuffer commandBuffer, uint32_t set);
+	//! The CmdBegin and CmdEnd member functions
+	/*!
+	Record the timestamps either side of a pass
+	*/
+	void CmdBegin(VkCommandBuffer commandBuffer, uint32_t set, GpuPass pass);
+	void CmdEnd(VkCommandBuffer commandBuffer, uint32_t set, GpuPass pass);
+	//! The CmdBeginFragments and CmdEndFragments member functions
+	/*!
+	Record the fragment shader invocation query around the GBuffer pass, outside of the render pass
+	*/
+	void CmdBeginFragments(VkCommandBuffer commandBuffer, uint32_t set);
+	void CmdEndFragments(VkCommandBuffer commandBuffer, uint32_t set);
+
+	//! The Submitted member function
+	/*!
+	Marks a set as submitted so its results are read back by Collect
+	*/
+	void Submitted(uint32_t set);
+	//! The Collect member function
+	/*!
+	Reads back a submitted set without waiting, call once the fence for the submission has been signaled.
+	Returns false if the results are not available yet.
+	*/
+	bool Collect(uint32_t set);
+
+	//! The GetPassMs member function
+	/*!
+	Returns the rolling average GPU time of a pass in milliseconds
+	*/
+	float GetPassMs(GpuPass pass) const;
+	//! The GetPassName function
+	/*!
+	Returns the name of a pass used in reports
+	*/
+	static const char* GetPassName(GpuPass pass);
+	//! The GetFragmentCount member function
+	/*!
+	Returns the rolling average of the GBuffer's fragment shader invocations per frame, 0 if they are not counted
+	*/
+	uint64_t GetFragmentCount() const;
+
+	//! The Report member function
+	/*!
+	Print the rolling average of each pass
+	*/
+	void Report(std::ostream& out) const;
+	//! The ReportSummary member function
+	/*!
+	Print min/mean/percentiles of every pass time recorded
+	*/
+	void ReportSummary(std::ostream& out) const;
+	//! The ClearStatistics member function
+	/*!
+	Forget the pass times recorded so far (e.g. after warm up frames)
+	*/
+	void ClearStatistics();
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <glfw3.h>
+
+class VulkanEngine;
+
+//! Material
+/*!
+Holds the albedo, normal and specular textures shared by every object drawn with them, and the descriptor set that binds them.
+Objects using the same textures share one Material so the textures are only loaded once and only one descriptor set is needed.
+*/
+class Material
+{
+private:
+	//! Private VkDevice reference.
+	/*! Required to create or destroying most vulkan objects */
+	VkDevice& m_Device;
+
+	//! Private VkImage, VkDeviceMemory, VkImageView and VkSampler.
+	/*! Required components for storing the albedo texture */
+	VkImage textureImage;
+	VkDeviceMemory textureImageMemory;
+	VkImageView textureImageView;
+	VkSampler textureSampler;
+	//! Private VkImage, VkDeviceMemory, VkImageView and VkSampler.
+	/*! Required components for storing the normal map texture */
+	VkImage ntextureImage;
+	VkDeviceMemory ntextureImageMemory;
+	VkImageView ntextureImageView;
+	VkSampler ntextureSampler;
+	//! Private VkImage, VkDeviceMemory, VkImageView and VkSampler.
+	/*! Required components for storing the specular texture */
+	VkImage stextureImage;
+	VkDeviceMemory stextureImageMemory;
+	VkImageView stextureImageView;
+	VkSampler stextureSampler;
+
+public:
+	//! Material Contructor
+	/*!
+	Loads the textures
+	\param engine VulkanEngine*, pointer to the vulkan engine
+	\param device VkDevice&, logical device referance
+	\param graphicsQueue VkQueue, queue used to upload the textures
+	\param commandPool VkCommandPool, used in the processes for creating objects related to textures
+	\param texturePath const char*, text path to the albedo texture file
+	\param nTexturePath const char*, text path to the normal texture file
+	\param sTexturePath const char*, text path to the specular texture file
+	*/
+	Material(VulkanEngine* engine, VkDevice& device, VkQueue graphicsQueue, VkCommandPool commandPool, const char* texturePath, const char* nTexturePath, const char* sTexturePath);
+	//! Material Decontructor
+	/*!
+	Cleans up the textures
+	*/
+	~Material();
+
+	//! Public VkDescriptorSet.
+	/*! Binds the textures (and, through a dynamic offset, the uniform block of the object being drawn)*/
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+	//! Public Get functions.
+	/*!
+	Functions for getting the texture views and samplers
+	*/
+	VkImageView& GetTextureImageView() { return textureImageView; }
+	VkSampler& GetTextureSampler() { return textureSampler; }
+	VkImageView& GetNormalTextureImageView() { return ntextureImageView; }
+	VkSampler& GetNormalTextureSampler() { return ntextureSampler; }
+	VkImageView& GetSpecTextureImageView() { return stextureImageView; }
+	VkSampler& GetSpecTextureSampler() { return stextureSampler; }
+};
@@ -1,15 +1,48 @@
 #pragma once
-#define SAMPLES	25
+#define MAX_SAMPLES	25
 #define STRENGTH	{	.48f,	.41f,	.28f	}
 #define FALLOFF		{	1.f,	.37f,	.3f		}
+#define MAX_PROFILES	4 //Diffusion profiles the blur can pick from per pixel
+#define MAX_MERGE_GAP	0.5f //Furthest apart (in kernel units) two taps can be and still share a bilinear fetch
+#define MERGE_TOLERANCE	(2.0f / 255.0f) //Largest difference allowed between the merged and original kernel, two steps of an 8 bit swap chain
+#define ADAPTIVE_TIERS	3
+#define ADAPTIVE_TAPS	35 //7 + 11 + 17, the smaller kernels packed one after another
+#define BURLEY_SAMPLES	17 //Centre plus 16 disk taps
 
 #define GLFW_INCLUDE_VULKAN
+#include <glfw3.h>
 #include <GLM/glm.hpp>
 
+#include <vector>
+
+class VulkanEngine;
+
+//! SubsurfaceProfile
+/*!
+Parameters of one diffusion profile, the kernel is the sum-of-gaussians skin profile shaped by these
+*/
+struct SubsurfaceProfile
+{
+	//! Public vec3.
+	/*! How much of each colour channel (rgb) is scattered, the rest stays at the centre tap*/
+	glm::vec3 strength;
+	//! Public vec3.
+	/*! How far each colour channel (rgb) scatters*/
+	glm::vec3 falloff;
+};
+
 //! SubsufacePass
 /*!
 Contains the functions required for creation the Separable Kernel used for the Subsurface Scattering render pass.
 Also holds the infomations for the required frame buffer and handles clean up.
+The blur can also run as two compute dispatches, which own their storage images and pipelines here.
+The raster blur can run at half or quarter resolution, followed by a depth and normal aware upsample back to full resolution.
+It can also be temporally amortised, each frame blurs with a jittered subset of the taps and the vertical pass accumulates into reprojected history images held here.
+Neighbouring taps can be merged into single bilinear fetches, the merged kernel is checked against the original each time it is built.
+The compute blur can be limited to the screen tiles holding subsurface pixels, found each frame by a classification dispatch that also writes the blur's indirect dispatch arguments.
+The raster blur can pick a smaller kernel per pixel when the projected kernel is only a few pixels wide, the smaller kernels are built here with the main one.
+Every kernel is built once per diffusion profile, the blur picks the profile from the material ID the GBuffer writes with each pixel.
+The blur can also be swapped at runtime for a single pass of Burley normalized diffusion, importance sampled disk taps rotated per pixel.
 */
 class SubsurfacePass
 {
@@ -51,6 +84,120 @@ private:
 			0.358f * gaussian(falloff, 1.99f, offset) +
 			0.078f * gaussian(falloff, 7.41f, offset);
 	}
+
+	//! Private VkExtent2D.
+	/*! Size of the compute blur targets*/
+	VkExtent2D m_ComputeExtent = {};
+	//! Private struct.
+	/*! Specialization constants of the blur shaders, tap count (0), temporal phases (1), whether the history is accumulated (2), whether the depth is packed with the colour (3) and whether the kernel is picked per pixel (4)*/
+	struct BlurConstants
+	{
+		uint32_t sampleCount;
+		uint32_t temporalPhases;
+		VkBool32 accumulate;
+		VkBool32 packedDepth;
+		VkBool32 adaptive;
+	};
+	//! Private BlurConstants, VkSpecializationMapEntry and VkSpecializationInfo.
+	/*! [0] for the plain blur and [1] for the blur that accumulates the history*/
+	BlurConstants m_BlurConstants[2] = {};
+	VkSpecializationMapEntry m_BlurEntries[5] = {};
+	VkSpecializationInfo m_BlurInfo[2] = {};
+
+	//! Private boolean.
+	/*! Set by SetSampleCount when any profile's merged kernel is over the tolerance, the blur then uses the unmerged kernel until the tap count changes*/
+	bool m_MergeFallback = false;
+
+	//! The BuildMergedKernel member function
+	/*!
+	Fills mergedKernel with PairMergedTaps, or with the unmerged kernel if SetSampleCount found a profile's MergedKernelError above MERGE_TOLERANCE.
+	With the shipped profiles that happens at 9 to 15 and 19 taps, the fallback is reported when mergeTaps is set.
+	*/
+	void BuildMergedKernel();
+	//! The BuildAdaptiveKernels member function
+	/*!
+	Fills a profile's part of adaptiveKernel, and adaptiveTiers, with the 7, 11 and 17 tap kernels. Tiers with at least sampleCount taps are left empty
+	\param profile uint32_t, profile to build
+	*/
+	void BuildAdaptiveKernels(uint32_t profile);
+	//! The BuildBurleyKernel member function
+	/*!
+	Fills a profile's part of burleyKernel, the disk taps are importance sampled from the normalized diffusion of its widest channel
+	\param profile uint32_t, profile to build
+	*/
+	void BuildBurleyKernel(uint32_t profile);
+
+	//! The BuildKernel member function
+	/*!
+	Calulates a separable kernel using the stength and fall of variables, centre tap first
+	\param target vec4*, receives the samples taps
+	\param samples int, odd number of taps
+	\param diffusion SubsurfaceProfile, strength and falloff of the kernel
+	*/
+	void BuildKernel(glm::vec4* target, int samples, const SubsurfaceProfile& diffusion)
+	{
+		glm::vec3 strength = diffusion.strength;
+		glm::vec3 falloff = diffusion.falloff;
+		falloff *= 0.9f;
+		strength *= 0.85f;
+
+
+		static const float range = 2; //Max offset
+		static const float exponent = 2; //Square
+
+		float step = 2 * range / (samples - 1); //The step size for each sample
+
+		//Calculate offsets
+		for (int i = 0; i < samples; i++) //For each sample
+		{
+			float o = -range + float(i) * step;
+			float sign = o < 0 ? -1.f : 1.f;
+			target[i].w = range * sign * abs(pow(o, exponent)) / pow(range, exponent);
+		}
+
+		//Calculate strengths
+		for (int i = 0; i < samples; i++) //For each sample
+		{
+			//Calculate diffrence between offsets
+			float w0 = i > 0 ? abs(target[i].w - target[i - 1].w) : 0;
+			float w1 = i < samples - 1 ? abs(target[i].w - target[i + 1].w) : 0;
+			float area = (w0 + w1) / 2.f; //Average offset
+			glm::vec3 t = area * profile(falloff, target[i].w); //Multiply by Three-Layer skin model profile
+			//Set Values
+			target[i].x = t.x;
+			target[i].y = t.y;
+			target[i].z = t.z;
+		}
+
+		glm::vec4 t = target[samples / 2];
+		for (int i = samples / 2; i > 0; i--)
+			target[i] = target[i - 1];
+		target[0] = t;
+
+		//average areas
+		glm::vec3 sum = glm::vec3(0);
+		for (int i = 0; i < samples; i++)
+			sum += glm::vec3(target[i].x, target[i].y, target[i].z);
+
+		for (int i = 0; i < samples; i++)
+		{
+			target[i].x /= sum.x;
+			target[i].y /= sum.y;
+			target[i].z /= sum.z;
+		}
+
+		//Alter based on strength
+		target[0].x = (1.f - strength.x) + strength.x * target[0].x;
+		target[0].y = (1.f - strength.y) + strength.y * target[0].y;
+		target[0].z = (1.f - strength.z) + strength.z * target[0].z;
+
+		for (int i = 1; i < samples; i++)
+		{
+			target[i].x *= strength.x;
+			target[i].y *= strength.y;
+			target[i].z *= strength.z;
+		}
+	}
 public:
 	//! Public VkImage.
 	/*! Stores image data for the frame buffer*/
@@ -71,19 +218,126 @@ public:
 	//! Public VkRenderPass.
 	/*! Vulkan Pipeline, Graphics pipeline for the subsurface scattering passes*/
 	VkPipeline SSGraphicsPipeline;
+	//! Public VkPipelines.
+	/*! Copy the colour of pixels that are not subsurface scattered, so the blur only runs where the stencil is still 0.
+	maskPipeline runs first in the horizontal pass and marks the copied pixels in the stencil, copyPipeline repeats the copy in the final pass*/
+	VkPipeline maskPipeline;
+	VkPipeline copyPipeline;
 	//! Public VkDescriptorSet.
 	/*! Vulkan Descriptor Set, holds the reference to textures and uniform buffers*/
 	VkDescriptorSet finalSSet;
-	//! Public VkBuffer.
-	/*! Vulkan Buffer, Uniform buffer for subsurface scattering pass*/
-	VkBuffer SSUniform;
-	//! Public VkDeviceMemory.
-	/*! Vulkan Device Memory, Refernece to allocated memory for the uniform buffer*/
-	VkDeviceMemory SSUniformMemory;
+	//! Public VkDeviceSize.
+	/*! Offset of the uniform block for the subsurface scattering pass inside each frame's uniform ring region*/
+	VkDeviceSize SSUniformBlock;
+
+	//! Public VkImages, VkDeviceMemory and VkImageViews.
+	/*! Storage images written by the compute blur, [0] the horizontal result and [1] the vertical result. Kept in the general layout*/
+	VkImage blurImages[2];
+	VkDeviceMemory blurImageMemory[2];
+	VkImageView blurImageViews[2];
+	//! Public VkDescriptorSetLayout.
+	/*! Compute blur set 0, colour and depth samplers, the storage image written and the material ID sampler (binding 5)*/
+	VkDescriptorSetLayout computeSetLayout;
+	//! Public VkPipelineLayout and VkPipeline.
+	/*! Compute blur pipeline, set 1 is the frame set (for the kernel) and the blur direction is pushed*/
+	VkPipelineLayout computePipelineLayout;
+	VkPipeline computePipeline;
+	//! Public VkDescriptorSets.
+	/*! Compute blur sets, [0] reads the GBuffer colour and [1] reads the horizontal result*/
+	VkDescriptorSet computeSets[2];
+
+	//! Public boolean.
+	/*! True to run the compute blur only on the tiles listed by the classification pass. Set before the compute pipeline is created*/
+	bool tiled = false;
+	//! Public VkBuffer and VkDeviceMemory.
+	/*! Indirect dispatch arguments of the tiled blur followed by the list of tiles, recreated with the swap chain*/
+	VkBuffer tileBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory tileBufferMemory = VK_NULL_HANDLE;
+	//! Public VkDescriptorSetLayout, VkPipelineLayout and VkPipeline.
+	/*! Classification pass, reads the GBuffer colour and writes tileBuffer*/
+	VkDescriptorSetLayout classifySetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout classifyPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline classifyPipeline = VK_NULL_HANDLE;
+	//! Public VkDescriptorSet.
+	/*! Classification set, the GBuffer colour and tileBuffer*/
+	VkDescriptorSet classifySet;
+	//! Public VkPipeline.
+	/*! Blur run over the listed tiles, uses computePipelineLayout and the compute sets*/
+	VkPipeline tileBlurPipeline = VK_NULL_HANDLE;
+	//! Public VkPipeline and VkDescriptorSet.
+	/*! Copies the vertical compute result into the swap chain image, with the screen space pipeline layout*/
+	VkPipeline compositePipeline;
+	VkDescriptorSet compositeSet;
+
+	//! Public uint32_t.
+	/*! Divides the resolution the raster blur runs at, 1 for full resolution, 2 for half or 4 for quarter*/
+	uint32_t resolutionScale = 1;
+	//! Public VkExtent2D.
+	/*! Size of the reduced resolution targets*/
+	VkExtent2D scaledExtent = {};
+	//! Public VkImages, VkDeviceMemory and VkImageViews.
+	/*! Reduced resolution blur targets in the swap chain format, [0] the horizontal result and [1] the vertical result*/
+	VkImage scaledImages[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	VkDeviceMemory scaledImageMemory[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	VkImageView scaledImageViews[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	//! Public VkImage, VkDeviceMemory and VkImageView.
+	/*! Reduced resolution depth/stencil holding the subsurface mask for both reduced passes*/
+	VkImage scaledStencilImage = VK_NULL_HANDLE;
+	VkDeviceMemory scaledStencilImageMemory = VK_NULL_HANDLE;
+	VkImageView scaledStencilImageView = VK_NULL_HANDLE;
+	//! Public VkFramebuffers.
+	/*! Reduced resolution frame buffers, compatible with SSRenderPass and SSLoadRenderPass*/
+	VkFramebuffer scaledFrameBuffers[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	//! Public VkRenderPass.
+	/*! Same as SSRenderPass but keeps the stencil written by the horizontal pass, used by the reduced vertical pass*/
+	VkRenderPass SSLoadRenderPass;
+	//! Public VkDescriptorSets.
+	/*! Reduced vertical pass set (reads the reduced horizontal result) and the upsample set (reduced result, full resolution normals and colour)*/
+	VkDescriptorSet scaledVerticalSet;
+	VkDescriptorSet upsampleSet;
+	//! Public VkPipeline.
+	/*! Bilateral upsample of the reduced blur into the swap chain image*/
+	VkPipeline upsamplePipeline = VK_NULL_HANDLE;
+
+	//! Public uint32_t.
+	/*! Number of frames the kernel taps are spread over, 1 blurs with every tap each frame and keeps no history*/
+	uint32_t temporalPhases = 1;
+	//! Public float.
+	/*! Weight of the current frame when it is blended with the reprojected history*/
+	float historyBlend = 0.2f;
+	//! Public uint32_t.
+	/*! Frames written since the history images were created, the history is only read once it is above 0*/
+	uint32_t historyAge = 0;
+	//! Public VkImages, VkDeviceMemory and VkImageViews.
+	/*! Accumulated blur (rgb) and its depth (a), one per frame in flight. Frame i writes image i and reads the previous frame's*/
+	std::vector<VkImage> historyImages;
+	std::vector<VkDeviceMemory> historyImageMemory;
+	std::vector<VkImageView> historyImageViews;
+	//! Public VkRenderPass and VkFramebuffers.
+	/*! Vertical pass into a history image, the stencil written by the horizontal pass is kept*/
+	VkRenderPass historyRenderPass = VK_NULL_HANDLE;
+	std::vector<VkFramebuffer> historyFrameBuffers;
+	//! Public VkPipelines.
+	/*! Accumulating vertical blur and the copy of the pixels without subsurface scattering, for historyRenderPass*/
+	VkPipeline temporalPipeline = VK_NULL_HANDLE;
+	VkPipeline historyCopyPipeline = VK_NULL_HANDLE;
+	//! Public VkDescriptorSets.
+	/*! Per history image, the set of the vertical pass writing it and the set copying it into the swap chain image*/
+	std::vector<VkDescriptorSet> temporalSets;
+	std::vector<VkDescriptorSet> historyCompositeSets;
+
+	//! Public SubsurfaceProfile Array.
+	/*! Diffusion profiles indexed by the material ID, skin, wax, marble and leaves. Change them with SetProfile*/
+	SubsurfaceProfile profiles[MAX_PROFILES] = {
+		{ STRENGTH, FALLOFF },
+		{ { .6f, .5f, .4f }, { 1.f, .8f, .6f } },
+		{ { .3f, .3f, .28f }, { .9f, .9f, .85f } },
+		{ { .35f, .5f, .2f }, { .5f, 1.f, .4f } },
+	};
 
 	//! Public vec4 Array.
-	/*! Array, holds the 1D kernel (Default contains a precomputed kernel for refernce) */
-	glm::vec4 kernel[SAMPLES] = {
+	/*! Array, holds the 1D kernel of each profile, MAX_SAMPLES entries apart (Default contains a precomputed skin kernel for refernce) */
+	glm::vec4 kernel[MAX_PROFILES * MAX_SAMPLES] = {
 			glm::vec4(0.530605, 0.613514, 0.739601, 0),
 			glm::vec4(0.000973794, 1.11862e-005, 9.43437e-007, -3),
 			glm::vec4(0.00333804, 7.85443e-005, 1.2945e-005, -2.52083),
@@ -111,77 +365,232 @@ public:
 			glm::vec4(0.000973794, 1.11862e-005, 9.43437e-007, 3),
 	};
 	
-	//! The computeKernel member function
+	//! Public uint32_t.
+	/*! Incremented each time computeKernel runs, so users of the kernel know when to re-upload it*/
+	uint32_t kernelVersion = 0;
+	//! Public uint32_t.
+	/*! Number of kernel taps used by the blur, odd and at most MAX_SAMPLES. Entries past it are zero*/
+	uint32_t sampleCount = MAX_SAMPLES;
+
+	//! Public boolean.
+	/*! True to blur with mergedKernel, needs a linear sampler on the blur's colour input. Set before the blur pipelines are created*/
+	bool mergeTaps = false;
+	//! Public vec4 Array.
+	/*! kernel with neighbouring taps merged, built with it. Per profile the centre first, then the merged taps, entries past mergedCount are zero*/
+	glm::vec4 mergedKernel[MAX_PROFILES * MAX_SAMPLES] = {};
+	//! Public uint32_t.
+	/*! Number of taps in each profile of mergedKernel, sampleCount if merging any profile did not pass its check. Only depends on the tap count set*/
+	uint32_t mergedCount = MAX_SAMPLES;
+
+	//! The BlurKernel member function
 	/*!
-	Calulates the separable kernel using the stength and fall of variables
-	Result stored in the kernel array.
+	Returns the kernel table the blur shaders read, mergedKernel if mergeTaps is set otherwise kernel
 	*/
-	void computeKernel()
-	{
-		glm::vec3 strength = STRENGTH;
-		glm::vec3 falloff = FALLOFF;
-		falloff *= 0.9f;
-		strength *= 0.85f;
+	const glm::vec4* BlurKernel() const { return mergeTaps ? mergedKernel : kernel; }
+	//! The BlurTapCount member function
+	/*!
+	Returns the number of taps in BlurKernel
+	*/
+	uint32_t BlurTapCount() const { return mergeTaps ? mergedCount : sampleCount; }
+	//! The PairMergedTaps member function
+	/*!
+	Fills mergedKernel from kernel, pairing neighbouring taps on each side of the centre (closest first) when they are no more than MAX_MERGE_GAP apart.
+	A pair becomes one tap with the summed weights, placed between the two in proportion to their weights so a bilinear fetch there blends them.
+	Does not check the result, the kernel test calls it to measure the pairing without the fallback.
+	*/
+	void PairMergedTaps();
+	//! The MergedKernelError member function
+	/*!
+	Blurs test rows of a linearly filtered texture with both kernels of a profile at several widths and returns the largest difference of any channel.
+	The rows are sine waves of at least 16 texels period, about as sharp as the lighting the blur sees.
+	\param profile uint32_t, profile whose kernels are compared
+	*/
+	float MergedKernelError(uint32_t profile) const;
 
+	//! Public boolean.
+	/*! True for the raster blur to pick the smallest kernel in adaptiveTiers that covers its projected width, falling back to BlurKernel. Set before the blur pipelines are created*/
+	bool adaptive = false;
+	//! Public vec4 Array.
+	/*! The smaller kernels one after another, each centre first, repeated for each profile ADAPTIVE_TAPS entries apart. Built with kernel*/
+	glm::vec4 adaptiveKernel[MAX_PROFILES * ADAPTIVE_TAPS] = {};
+	//! Public vec4 Array.
+	/*! Per smaller kernel, x its first entry in adaptiveKernel, y its tap count (0 if unused) and z the widest projected kernel (pixels from the centre to the last tap) it is used for*/
+	glm::vec4 adaptiveTiers[ADAPTIVE_TIERS] = {};
 
-		static const float range = 2; //Max offset
-		static const float exponent = 2; //Square
+	//! Public boolean.
+	/*! True to run the Burley disk blur instead of the separable blur. Can change at runtime, the command buffers must then be recorded again*/
+	bool burley = false;
+	//! Public vec4 Array.
+	/*! Burley disk taps of each profile, BURLEY_SAMPLES entries apart. The centre first, then rgb weight and radius in kernel units (a) from the nearest tap out*/
+	glm::vec4 burleyKernel[MAX_PROFILES * BURLEY_SAMPLES] = {};
+	//! Public VkPipeline.
+	/*! Burley disk blur into the swap chain image, uses the screen space pipeline layout and the horizontal pass's set*/
+	VkPipeline burleyPipeline = VK_NULL_HANDLE;
 
-		float step = 2 * range / (SAMPLES - 1); //The step size for each sample
+	//! Public boolean.
+	/*! True if the GBuffer packs the depth into the colour target's alpha, so each blur tap is a single fetch. Set before the targets are created*/
+	bool packedDepth = false;
+	//! The ColourFormat member function
+	/*!
+	Returns the format of the GBuffer colour and horizontal blur targets, half float when they also carry the depth
+	\param format VkFormat, format used without packed depth
+	*/
+	VkFormat ColourFormat(VkFormat format) const { return packedDepth ? VK_FORMAT_R16G16B16A16_SFLOAT : format; }
 
-		//Calculate offsets
-		for (int i = 0; i < SAMPLES; i++) //For each sample
-		{
-			float o = -range + float(i) * step;
-			float sign = o < 0 ? -1.f : 1.f;
-			kernel[i].w = range * sign * abs(pow(o, exponent)) / pow(range, exponent);
-		}
+	//! The SetSampleCount member function
+	/*!
+	Changes the number of taps and recomputes the kernel, the blur pipelines must be created after this.
+	Also decides whether the merged kernel is used, from the profiles at the time
+	\param count uint32_t, odd tap count between 3 and MAX_SAMPLES (7, 11, 17 and 25 are the usual tiers)
+	*/
+	void SetSampleCount(uint32_t count);
+	//! The SetProfile member function
+	/*!
+	Changes a diffusion profile and rebuilds its kernels, does nothing if the parameters are unchanged. BlurTapCount stays the same
+	\param index uint32_t, material ID of the profile, below MAX_PROFILES
+	\param profile SubsurfaceProfile, new strength and falloff
+	*/
+	void SetProfile(uint32_t index, const SubsurfaceProfile& profile);
+	//! The BlurSpecialization member function
+	/*!
+	Returns the specialization info setting the blur shaders' tap count to BlurTapCount() and their temporal phases to temporalPhases
+	\param accumulate bool, true for the vertical blur that also blends with the history
+	*/
+	const VkSpecializationInfo* BlurSpecialization(bool accumulate = false);
 
-		//Calculate strengths
-		for (int i = 0; i < SAMPLES; i++) //For each sample
+	//! The computeKernel member function
+	/*!
+	Calulates the separable kernel of every profile
+	Result stored in the kernel array.
+	*/
+	void computeKernel()
+	{
+		const int samples = static_cast<int>(sampleCount);
+		for (uint32_t profile = 0; profile < MAX_PROFILES; profile++)
 		{
-			//Calculate diffrence between offsets
-			float w0 = i > 0 ? abs(kernel[i].w - kernel[i - 1].w) : 0;
-			float w1 = i < SAMPLES - 1 ? abs(kernel[i].w - kernel[i + 1].w) : 0;
-			float area = (w0 + w1) / 2.f; //Average offset
-			glm::vec3 t = area * profile(falloff, kernel[i].w); //Multiply by Three-Layer skin model profile
-			//Set Values
-			kernel[i].x = t.x;
-			kernel[i].y = t.y;
-			kernel[i].z = t.z;
-		}
+			glm::vec4* target = &kernel[profile * MAX_SAMPLES];
+			BuildKernel(target, samples, profiles[profile]);
 
-		glm::vec4 t = kernel[SAMPLES / 2];
-		for (int i = SAMPLES / 2; i > 0; i--)
-			kernel[i] = kernel[i - 1];
-		kernel[0] = t;
-
-		//average areas
-		glm::vec3 sum = glm::vec3(0);
-		for (int i = 0; i < SAMPLES; i++)
-			sum += glm::vec3(kernel[i].x, kernel[i].y, kernel[i].z);
+			//Unused taps
+			for (int i = samples; i < MAX_SAMPLES; i++)
+				target[i] = glm::vec4(0);
+		}
 
-		for (int i = 0; i < SAMPLES; i++)
+		BuildMergedKernel();
+		for (uint32_t profile = 0; profile < MAX_PROFILES; profile++)
 		{
-			kernel[i].x /= sum.x;
-			kernel[i].y /= sum.y;
-			kernel[i].z /= sum.z;
+			BuildAdaptiveKernels(profile);
+			BuildBurleyKernel(profile);
 		}
+		kernelVersion++;
+	}
 
-		//Alter based on strength
-		kernel[0].x = (1.f - strength.x) + strength.x * kernel[0].x;
-		kernel[0].y = (1.f - strength.y) + strength.y * kernel[0].y;
-		kernel[0].z = (1.f - strength.z) + strength.z * kernel[0].z;
+	//! The CreateComputeTargets member function
+	/*!
+	Creates the two storage images written by the compute blur, recreated with the swap chain
+	\param engine VulkanEngine*, used to create the images
+	\param extent VkExtent2D, size of the images
+	*/
+	void CreateComputeTargets(VulkanEngine* engine, VkExtent2D extent);
+	//! The CreateTilePipelines member function
+	/*!
+	Creates the classification pass and the tiled blur, CreateComputePipeline must be called first
+	\param device VkDevice, logical device
+	\param classifyModule VkShaderModule, the compiled classification compute shader
+	\param blurModule VkShaderModule, the compiled tiled blur compute shader
+	*/
+	void CreateTilePipelines(VkDevice device, VkShaderModule classifyModule, VkShaderModule blurModule);
+	//! The CreateComputePipeline member function
+	/*!
+	Creates the compute blur's set layout, pipeline layout and pipeline
+	\param device VkDevice, logical device
+	\param shaderModule VkShaderModule, the compiled blur compute shader
+	\param frameSetLayout VkDescriptorSetLayout, layout of the frame set bound as set 1
+	*/
+	void CreateComputePipeline(VkDevice device, VkShaderModule shaderModule, VkDescriptorSetLayout frameSetLayout);
+	//! The UpdateComputeSets member function
+	/*!
+	Points the compute, classification and composite sets at the current images
+	\param device VkDevice, logical device
+	\param colourView VkImageView, resolved GBuffer colour
+	\param depthView VkImageView, resolved GBuffer depth
+	\param normalView VkImageView, resolved GBuffer normals with the material ID in alpha
+	\param sampler VkSampler, nearest sampler used for every read
+	\param uniformBuffer VkBuffer, uniform ring holding SSUniformBlock, bound by the composite set
+	\param uniformRange VkDeviceSize, size of the composite set's uniform block
+	*/
+	void UpdateComputeSets(VkDevice device, VkImageView colourView, VkImageView depthView, VkImageView normalView, VkSampler sampler, VkBuffer uniformBuffer, VkDeviceSize uniformRange);
+	//! The CmdPrepareCompute member function
+	/*!
+	Makes the GBuffer visible to the compute blur and moves both targets into the general layout, their old contents are discarded
+	*/
+	void CmdPrepareCompute(VkCommandBuffer commandBuffer);
+	//! The CmdClassifyTiles member function
+	/*!
+	Lists the tiles holding subsurface pixels and counts them into the tiled blur's dispatch arguments.
+	Binds its own set 0, so must be recorded before the frame set is bound for the blur
+	\param commandBuffer VkCommandBuffer, buffer being recorded
+	*/
+	void CmdClassifyTiles(VkCommandBuffer commandBuffer);
+	//! The CmdDispatchBlur member function
+	/*!
+	Records one direction of the compute blur, the frame set must already be bound to computePipelineLayout.
+	When tiled it is an indirect dispatch over the listed tiles.
+	The vertical direction waits for the horizontal result and leaves its own result ready for the composite pass
+	\param commandBuffer VkCommandBuffer, buffer being recorded
+	\param vertical bool, false for the horizontal blur and true for the vertical blur
+	*/
+	void CmdDispatchBlur(VkCommandBuffer commandBuffer, bool vertical);
 
-		for (int i = 1; i < SAMPLES; i++)
-		{
-			kernel[i].x *= strength.x;
-			kernel[i].y *= strength.y;
-			kernel[i].z *= strength.z;
-		}
+	//! The CreateScaledTargets member function
+	/*!
+	Creates the reduced resolution images and frame buffers, only needed when resolutionScale is above 1. SSRenderPass must already exist
+	\param engine VulkanEngine*, used to create the images
+	\param device VkDevice, logical device
+	\param extent VkExtent2D, full resolution size, divided by resolutionScale
+	\param colourFormat VkFormat, format of SSImage
+	\param stencilFormat VkFormat, depth/stencil format used by SSRenderPass
+	*/
+	void CreateScaledTargets(VulkanEngine* engine, VkDevice device, VkExtent2D extent, VkFormat colourFormat, VkFormat stencilFormat);
+	//! The UpdateScaledSets member function
+	/*!
+	Points the reduced vertical set and the upsample set at the current images, does nothing at full resolution
+	\param device VkDevice, logical device
+	\param colourView VkImageView, resolved GBuffer colour
+	\param depthView VkImageView, resolved GBuffer depth
+	\param normalView VkImageView, resolved GBuffer normals with the material ID in alpha
+	\param sampler VkSampler, nearest sampler used for every read
+	\param uniformBuffer VkBuffer, uniform ring holding SSUniformBlock
+	\param uniformRange VkDeviceSize, size of the uniform block
+	*/
+	void UpdateScaledSets(VkDevice device, VkImageView colourView, VkImageView depthView, VkImageView normalView, VkSampler sampler, VkBuffer uniformBuffer, VkDeviceSize uniformRange);
 
-		
-	}
+	//! The CreateHistoryTargets member function
+	/*!
+	Creates the history images, their render pass and frame buffers, only needed when temporalPhases is above 1. Resets historyAge
+	\param engine VulkanEngine*, used to create the images
+	\param device VkDevice, logical device
+	\param graphicsQueue VkQueue, queue used to move the images into the shader read layout
+	\param commandPool VkCommandPool, pool the transition is recorded from
+	\param extent VkExtent2D, size of the images
+	\param count uint32_t, number of history images (frames in flight)
+	\param stencilView VkImageView, full resolution depth/stencil holding the subsurface mask
+	\param stencilFormat VkFormat, format of the depth/stencil
+	*/
+	void CreateHistoryTargets(VulkanEngine* engine, VkDevice device, VkQueue graphicsQueue, VkCommandPool commandPool, VkExtent2D extent, uint32_t count, VkImageView stencilView, VkFormat stencilFormat);
+	//! The UpdateHistorySets member function
+	/*!
+	Points the temporal and history composite sets at the current images, does nothing without temporal phases
+	\param device VkDevice, logical device
+	\param horizontalView VkImageView, result of the horizontal blur
+	\param depthView VkImageView, resolved GBuffer depth
+	\param normalView VkImageView, resolved GBuffer normals with the material ID in alpha
+	\param motionView VkImageView, resolved GBuffer motion, the offset to each pixel's position last frame
+	\param sampler VkSampler, nearest sampler used for every read
+	\param uniformBuffer VkBuffer, uniform ring holding SSUniformBlock
+	\param uniformRange VkDeviceSize, size of the uniform block
+	*/
+	void UpdateHistorySets(VkDevice device, VkImageView horizontalView, VkImageView depthView, VkImageView normalView, VkImageView motionView, VkSampler sampler, VkBuffer uniformBuffer, VkDeviceSize uniformRange);
 
 	//! The CleanUpBuffer member function
 	/*!
@@ -195,17 +604,69 @@ public:
 
 		vkDestroyFramebuffer(device, SSFrameBuffer, nullptr);
 		vkDestroyRenderPass(device, SSRenderPass, nullptr);
+		vkDestroyRenderPass(device, SSLoadRenderPass, nullptr);
 
 		vkDestroyPipeline(device, SSGraphicsPipeline, nullptr);
-	}
+		vkDestroyPipeline(device, maskPipeline, nullptr);
+		vkDestroyPipeline(device, copyPipeline, nullptr);
+		vkDestroyPipeline(device, burleyPipeline, nullptr);
+
+		for (int i = 0; i < 2; i++)
+		{
+			vkDestroyImageView(device, blurImageViews[i], nullptr);
+			vkDestroyImage(device, blurImages[i], nullptr);
+			vkFreeMemory(device, blurImageMemory[i], nullptr);
+		}
+		vkDestroyPipeline(device, compositePipeline, nullptr);
+
+		//Null unless tiled
+		vkDestroyBuffer(device, tileBuffer, nullptr);
+		vkFreeMemory(device, tileBufferMemory, nullptr);
+		tileBuffer = VK_NULL_HANDLE;
+		tileBufferMemory = VK_NULL_HANDLE;
+
+		//Null at full resolution
+		for (int i = 0; i < 2; i++)
+		{
+			vkDestroyFramebuffer(device, scaledFrameBuffers[i], nullptr);
+			vkDestroyImageView(device, scaledImageViews[i], nullptr);
+			vkDestroyImage(device, scaledImages[i], nullptr);
+			vkFreeMemory(device, scaledImageMemory[i], nullptr);
+		}
+		vkDestroyImageView(device, scaledStencilImageView, nullptr);
+		vkDestroyImage(device, scaledStencilImage, nullptr);
+		vkFreeMemory(device, scaledStencilImageMemory, nullptr);
+		vkDestroyPipeline(device, upsamplePipeline, nullptr);
 
-	//! The CleanUp member function
+		//Empty without temporal phases
+		for (size_t i = 0; i < historyImages.size(); i++)
+		{
+			vkDestroyFramebuffer(device, historyFrameBuffers[i], nullptr);
+			vkDestroyImageView(device, historyImageViews[i], nullptr);
+			vkDestroyImage(device, historyImages[i], nullptr);
+			vkFreeMemory(device, historyImageMemory[i], nullptr);
+		}
+		historyImages.clear();
+		historyImageMemory.clear();
+		historyImageViews.clear();
+		historyFrameBuffers.clear();
+		vkDestroyRenderPass(device, historyRenderPass, nullptr);
+		vkDestroyPipeline(device, temporalPipeline, nullptr);
+		vkDestroyPipeline(device, historyCopyPipeline, nullptr);
+	}
+	//! The CleanUpCompute member function
 	/*!
-	Cleans up vulkan objects for the uniform buffer
+	Cleans up the compute blur pipeline, which lives as long as the device
 	*/
-	void CleanUp(VkDevice &device)
+	void CleanUpCompute(VkDevice device)
 	{
-		vkDestroyBuffer(device, SSUniform, nullptr);
-		vkFreeMemory(device, SSUniformMemory, nullptr);
+		vkDestroyPipeline(device, computePipeline, nullptr);
+		vkDestroyPipelineLayout(device, computePipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, computeSetLayout, nullptr);
+
+		vkDestroyPipeline(device, tileBlurPipeline, nullptr);
+		vkDestroyPipeline(device, classifyPipeline, nullptr);
+		vkDestroyPipelineLayout(device, classifyPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, classifySetLayout, nullptr);
 	}
 };
\ No newline at end of file
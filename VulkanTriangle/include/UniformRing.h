@@ -0,0 +1,94 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <glfw3.h>
+
+#include "VulkanEngine.h"
+
+//! UniformRing
+/*!
+One persistently mapped, host coherent uniform buffer split into a region per frame in flight.
+Uniform blocks are sub-allocated once with Reserve, so every block sits at the same offset inside each frame's region.
+Those offsets are stable, which lets pre-recorded command buffers bake them in as dynamic offsets,
+and a frame only ever writes its own region so nothing the GPU is still reading gets overwritten.
+The buffer usage can be changed on creation, so the same scheme also holds per frame indirect draw commands.
+*/
+class UniformRing
+{
+private:
+	//! Private VkDevice.
+	/*! Logical device the buffer belongs to*/
+	VkDevice m_Device = VK_NULL_HANDLE;
+	//! Private VkBuffer.
+	/*! The buffer holding every frame's region*/
+	VkBuffer m_Buffer = VK_NULL_HANDLE;
+	//! Private VkDeviceMemory.
+	/*! Host visible, host coherent memory bound to the buffer*/
+	VkDeviceMemory m_Memory = VK_NULL_HANDLE;
+	//! Private pointer.
+	/*! CPU side pointer to the start of the buffer, mapped for the lifetime of the ring*/
+	char* m_Mapped = nullptr;
+	//! Private VkDeviceSize.
+	/*! Alignment every block (and frame region) starts on, the larger of minUniformBufferOffsetAlignment and minStorageBufferOffsetAlignment*/
+	VkDeviceSize m_Alignment = 1;
+	//! Private VkDeviceSize.
+	/*! Bytes reserved in each frame's region so far*/
+	VkDeviceSize m_FrameSize = 0;
+	//! Private uint32_t.
+	/*! Number of frame regions*/
+	uint32_t m_FrameCount = 0;
+
+	//! The align member function
+	/*!
+	Rounds a size up to the next multiple of the alignment
+	*/
+	VkDeviceSize align(VkDeviceSize size) const { return (size + m_Alignment - 1) & ~(m_Alignment - 1); }
+
+public:
+	//! The SetAlignment member function
+	/*!
+	Read the offset alignment from the device, must be called before any blocks are reserved
+	*/
+	void SetAlignment(VkPhysicalDevice physicalDevice);
+	//! The Reserve member function
+	/*!
+	Sub-allocate a block in every frame's region, returns its offset from the start of the region
+	\param size VkDeviceSize, size of the uniform block in bytes
+	*/
+	VkDeviceSize Reserve(VkDeviceSize size);
+	//! The Create member function
+	/*!
+	Create and map the buffer once every block has been reserved
+	\param engine VulkanEngine*, used to create the buffer
+	\param device VkDevice, logical device
+	\param frameCount uint32_t, number of frames that can be in flight
+	\param usage VkBufferUsageFlags, how the buffer is read by the GPU
+	*/
+	void Create(VulkanEngine* engine, VkDevice device, uint32_t frameCount, VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	//! The CleanUp member function
+	/*!
+	Unmap and destroy the buffer
+	*/
+	void CleanUp();
+
+	//! The Buffer member function
+	/*!
+	Returns the buffer to write into the descriptor sets (with an offset of 0, the block is picked by the dynamic offset)
+	*/
+	VkBuffer Buffer() const { return m_Buffer; }
+	//! The Offset member function
+	/*!
+	Returns the dynamic offset of a block in a frame's region
+	*/
+	uint32_t Offset(uint32_t frame, VkDeviceSize block) const { return static_cast<uint32_t>(frame * m_FrameSize + block); }
+	//! The Write member function
+	/*!
+	Copy data into a block of a frame's region, the frame must not be in flight
+	*/
+	void Write(uint32_t frame, VkDeviceSize block, const void* data, VkDeviceSize size);
+	//! The Mapped member function
+	/*!
+	Returns a pointer to a block of a frame's region, for filling large blocks in place, the frame must not be in flight
+	*/
+	void* Mapped(uint32_t frame, VkDeviceSize block) const { return m_Mapped + Offset(frame, block); }
+};
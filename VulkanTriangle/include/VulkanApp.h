@@ -25,37 +25,71 @@
 
 #include "GLFW_Window.h"
 #include "VulkanObject.h"
+#include "Material.h"
 #include "VulkanEngine.h"
 
 #include "Lighting.h"
 #include "SubsurfacePass.h"
+#include "AppSettings.h"
+#include "FrameStatistics.h"
+#include "GpuProfiler.h"
+#include "UniformRing.h"
+#include "CommandRecorder.h"
+#include "FrustumCuller.h"
+#include "GeometryArena.h"
 
 
 
-/*! Uniform Buffer Object struct
-	Holds the model, view and projection matrix
+/*! Frame Uniform Buffer Object struct
+	Holds the camera, light and screen space matrices shared by every draw, written once per frame
 */
-struct UniformBufferObject {
-	glm::mat4 model;
+struct FrameUniformBufferObject {
 	glm::mat4 view;
 	glm::mat4 proj;
 	glm::mat4 lightRot;
-	glm::mat4 lightSpace;
 	glm::mat4 lightViewProj;
 
 	//Lighting
 	glm::vec4 AmbientColour;
 	glm::vec4 DirectionalColour;
+
+	//Frustum planes (xyz inward normal, w distance) of the camera and light, used by the culling pre-pass
+	glm::vec4 cameraPlanes[6];
+	glm::vec4 shadowPlanes[6];
+
+	//Temporal subsurface scattering, last frame's camera view projection for reprojecting the history,
+	//x frame index, y temporal phases, z weight of the current frame and w 1 once the history holds a frame
+	glm::mat4 prevViewProj;
+	glm::vec4 temporal;
+
+	//Inverse of this frame's camera view projection, the lighting pass rebuilds world positions from the GBuffer depth with it
+	glm::mat4 invViewProj;
 };
-struct OffScreenUniformBufferObject {
-	glm::mat4 depthMVP;
+/*! Object Data struct
+	One element of the object storage buffer, holds the model matrix, lit flag, world bounds and mesh of an object, and last frame's model matrix.
+	Only written when they change, read by the vertex shaders (indexed by instance) and the culling pre-pass
+*/
+struct ObjectData {
+	glm::mat4 model;
+	glm::vec4 lit; //x is 1 if the object is lit, y is 1 if it is subsurface scattered, z is its material ID
+	glm::vec4 sphere; //xyz centre of the world bounds, w radius of the bounding sphere
+	glm::vec4 extents; //xyz half size of the world bounds box, w is 1 if the object casts a shadow
+	glm::uvec4 mesh; //Index count, first index, vertex offset and the draw command slot of the object
+	glm::mat4 prevModel; //Model matrix of the previous frame, gives the per object motion for reprojection
 };
+/*! Kernel Uniform Buffer Object struct
+	Holds the separable subsurface scattering kernel and the smaller adaptive kernels of each profile, only written when they are recomputed
+*/
+struct KernelUniformBufferObject {
+	glm::vec4 kernel[MAX_PROFILES * MAX_SAMPLES];
+	glm::vec4 adaptiveKernel[MAX_PROFILES * ADAPTIVE_TAPS];
+	glm::vec4 adaptiveTiers[ADAPTIVE_TIERS];
+	glm::vec4 burleyKernel[MAX_PROFILES * BURLEY_SAMPLES];
+};
+/*! GBuffer Uniform Buffer Object struct
+	Holds the blur direction of a subsurface scattering pass
+*/
 struct GBufferUniformBufferObject {
-	glm::mat4 model;
-	glm::mat4 view;
-	glm::mat4 proj;
-
-	glm::vec4 kernel[SAMPLES];
 	glm::vec2 blurDirection;
 };
 
@@ -78,16 +112,28 @@ class VulkanApp {
 		FrameBufferAttachment depth;
 		VkRenderPass renderPass;
 		VkSampler depthSampler;
+		VkSampler shadowSampler; //Compare enabled, for the hardware filtered shadow taps
 		VkDescriptorImageInfo descriptor;
 	} offscreenPass;
 
 
 	struct GFrameBuffer {
 		VkFramebuffer frameBuffer;
-		FrameBufferAttachment position, normal, albedo;
+		FrameBufferAttachment motion, normal, albedo;
+		FrameBufferAttachment depthCopy; //The depth written as a colour, so it can be resolved and sampled
 		FrameBufferAttachment depth;
 		VkRenderPass renderPass;
 	} offScreenFrameBuf;
+	//Fullscreen pass shading the resolved GBuffer into colorImage, once per pixel
+	//With --gbuffer-subpasses it is the second subpass of the GBuffer render pass instead, and has no render pass of its own
+	struct LightingPass {
+		VkFramebuffer frameBuffer;
+		VkRenderPass renderPass;
+		VkPipeline pipeline;
+		VkDescriptorSet descriptorSet;
+		VkDescriptorSetLayout setLayout = VK_NULL_HANDLE; //Subpass only, set 0 with the GBuffer as input attachments
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE; //Subpass only, setLayout and the frame set
+	} lightingPass;
 	// One sampler for the frame buffer color attachments
 	VkSampler colourSampler;
 private:
@@ -134,6 +180,8 @@ private:
 
 	/*! The swap chain that stores the framebuffers we will render too */
 	VkSwapchainKHR swapChain;
+	/*! Memory for the offscreen colour targets used in place of the swap chain images when running headless */
+	std::vector<VkDeviceMemory> headlessImageMemory;
 	std::vector<VkImage> swapChainImages; //Vector of each image we will render
 	VkFormat swapChainImageFormat; //Image formatting
 	VkExtent2D swapChainExtent; //Resolution
@@ -166,6 +214,8 @@ private:
 	/*! The command pool that holds all the command buffers we will use for each frame */
 	VkCommandPool commandPool;
 	std::vector<VkCommandBuffer> commandBuffers; //List of the command buffers, each containing the infomation of the commands to be carried out each frame (e.g. drawing, memory transfer etc)
+	/*! Threads and transient pools used instead of commandBuffers when recording each frame */
+	CommandRecorder commandRecorder;
 	std::vector<VkFence> inFlightFences; //Fences used to halt the command buffers from executing until the previos frame has completed
 	std::vector<VkSemaphore> imageAvailableSemaphores; //List of semaphores to signel if an image is available to render too (GPU Syncing)
 	std::vector<VkSemaphore> renderFinishedSemaphores; //List of semaphores to signel when the image is finished and can be presented (GPU Syncing)
@@ -186,25 +236,36 @@ private:
 
 		VulkanEngine* m_Engine;
 
+	/*! Options the app was started with */
+	AppSettings settings;
+
 
 public:
-	//Default contructor
-	VulkanApp() {};
+	//Contructor
+	VulkanApp(const AppSettings& appSettings = AppSettings()) : settings(appSettings) {};
 	//!Run function
 	/*! 
 	Sets up and window and vulkan instance, then enters the main loop.
+	When running headless no window is created and the benchmark loop is used instead.
 	Calls cleanup when the main loop is exited.
 	*/
 	void run() {
-		initWindow();
+		if (!settings.headless)
+			initWindow();
 		initVulkan();
-		mainLoop();
+		if (settings.headless)
+			benchmarkLoop();
+		else
+			mainLoop();
 		cleanup();
 	}
 
 	//! Public boolean
 	/*! True if the window has been resized */
 	bool framebufferResized = false;
+	//! Public boolean
+	/*! True if the subsurface scattering blur should switch between the separable and Burley versions before the next frame */
+	bool subsurfaceModeChanged = false;
 
 private:
 	//Initilise the window using GLFW
@@ -213,6 +274,8 @@ private:
 	const void initVulkan();
 	//The main loop, runs each frame
 	const void mainLoop();
+	//Headless loop, renders a fixed number of frames and prints the frame time statistics
+	const void benchmarkLoop();
 	//Clean up all remaining vulkan objects and memory
 	const void cleanup();
 
@@ -261,10 +324,16 @@ private:
 	//Change surface size/extents (x,y)
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 	void createSwapChain();
+	//Create offscreen colour targets in place of the swap chain images when running headless
+	void createHeadlessTargets();
 	//Create inital image views for forward rendering
 	void createImageViews();
 	//Create the required pipelines for rendering
 	void createGraphicsPipeline();
+	//Create a screen space pass pipeline, draws one fullscreen triangle with no vertex input using the screen space pipeline layout
+	//If stencil is given the subsurface mask is tested (and written) with it, specialization is passed to the fragment shader
+	//A layout and subpass can be given for passes that are not the first subpass or do not use the screen space layout
+	void createPostProcessPipeline(VkShaderModule fragShaderModule, VkRenderPass pass, VkPipeline& pipeline, const VkStencilOpState* stencil = nullptr, const VkSpecializationInfo* specialization = nullptr, VkPipelineLayout layout = VK_NULL_HANDLE, uint32_t subpass = 0);
 	//Create compiled shader modules
 	VkShaderModule createShaderModule(const std::vector<char>& code);
 	//Create render pass for forward rendering
@@ -273,14 +342,33 @@ private:
 	void createFramebuffers();
 	//Create command pool for storing command buffers
 	void createCommandPool();
-	//Create the command buffers required for rednering commands
+	//Create the command buffers required for rednering commands, pre-recorded unless they are recorded each frame
 	void createCommandBuffers();
+	//Start the recording threads when the command buffers are recorded each frame
+	void createCommandRecorder();
+	//Record every pass into a command buffer, the shadow and GBuffer draws are executed from the secondary buffers if given or recorded inline if not
+	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame, size_t image,
+		const std::vector<VkCommandBuffer>* shadowDraws = nullptr, const std::vector<VkCommandBuffer>* gbufferDraws = nullptr);
+	//Record a slice of the objects into the shadow pass
+	void recordShadowDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t first, size_t last);
+	//Record a slice of the objects into the GBuffer pass
+	void recordGBufferDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t first, size_t last);
+	//Record a slice of the objects' depth into the GBuffer pass ahead of every GBuffer draw
+	void recordDepthPrePassDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t first, size_t last);
+	//Bind the frame, kernel and object blocks of a frame as set 1 of a pipeline layout
+	void bindFrameSet(VkCommandBuffer commandBuffer, uint32_t frame, VkPipelineLayout layout, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS);
+	//Record the culling pre-pass that fills this frame's draw commands
+	void recordCullPass(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame);
+	//Record this frame's command buffer, the workers record the draws in parallel, returns the primary buffer to submit
+	VkCommandBuffer recordFrame(uint32_t frame, size_t image, uint32_t set);
 	//Draw frame, called once a frame to render and queue inscructions
 	void drawFrame();
 	//Create fences and semephores for syncing CPU and GPU
 	void createSyncObjects();
 	//Create the swap chain, used when the window is resized
 	void recreateSwapChain();
+	//Swap the separable and Burley subsurface blurs, waits for the device and records the command buffers again
+	void switchSubsurfaceMode();
 	//Clean up swap chain objects and memory before recreating it
 	void cleanupSwapChain();
 
@@ -288,23 +376,103 @@ private:
 
 	//Uniform layouts
 	VkDescriptorSetLayout descriptorSetLayout;
+	//Layout of set 0 for the scene passes, the textures of a material
+	VkDescriptorSetLayout materialSetLayout;
+	//Layout of set 1, the frame, kernel and object blocks bound once per pass
+	VkDescriptorSetLayout frameSetLayout;
+	//Layout of set 0 for the culling pre-pass, the draw commands it writes
+	VkDescriptorSetLayout cullSetLayout;
 	void createDescriptorSetLayout();
 
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
+	//Every uniform block lives in one mapped buffer, with a region per frame in flight
+	UniformRing uniformRing;
+	//Offset of the object storage block (an ObjectData per object) inside a frame's region
+	VkDeviceSize objectBlock;
+	//CPU copy of each object's data, rebuilt when the object changes and copied to each frame's region
+	std::vector<ObjectData> objectData;
+	//Offset of the frame and kernel blocks inside a frame's region
+	VkDeviceSize frameBlock;
+	VkDeviceSize kernelBlock;
+	//Number of frame regions that still hold an out of date copy of each block, counted down as each frame rewrites its copy
+	std::vector<uint32_t> objectDirtyFrames;
+	uint32_t kernelDirtyFrames = 0;
+	uint32_t screenPassDirtyFrames = 0;
+	//Kernel version last uploaded, compared against SubsurfacePass::kernelVersion
+	uint32_t uploadedKernelVersion = 0;
 	
 
 	void createUniformBuffers();
-	void updateUniformBuffer(uint32_t currentImage, unsigned int objectIndex);
+	//Size the culling bounds, group the objects into draw batches and create the draw command buffer
+	void createDrawCommands();
+	//Write the blocks shared by the whole frame, then the kernel and screen pass blocks if they are dirty
+	void updateFrameUniforms(uint32_t frame);
+	//Rebuild an object's data and bounds if it has changed, and write it if this frame's copy is stale
+	void updateUniformBuffer(uint32_t frame, unsigned int objectIndex);
+
+	//World space bounds of every object, tested against the camera and light frustums each frame
+	FrustumCuller objectCuller;
+	//Projection * view of the camera and of the light, set by updateFrameUniforms
+	glm::mat4 cameraViewProj = glm::mat4(1.0f);
+	glm::mat4 shadowViewProj;
+	//1 for each object inside the camera frustum (GBuffer pass) and light frustum (shadow pass) this frame
+	std::vector<uint8_t> cameraVisible;
+	std::vector<uint8_t> shadowVisible;
+	//Cull the objects for both passes on the CPU, only needed when recording each frame (the pre-recorded buffers cull on the GPU)
+	void cullObjects();
+
+	//Vertex and index data of every object
+	GeometryArena geometryArena;
+	/*! Draw Batch struct
+		A run of draw command slots sharing a material, drawn with one indirect call
+	*/
+	struct DrawBatch {
+		Material* material;
+		uint32_t firstSlot;
+		uint32_t count;
+	};
+	//Objects grouped by material, the draw commands of a batch are next to each other
+	std::vector<DrawBatch> drawBatches;
+	//Draw command slot of each object
+	std::vector<uint32_t> objectSlots;
+	//Draw commands written by the culling pre-pass, a region per frame holding the GBuffer commands then the shadow commands
+	VkBuffer drawCommandBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory drawCommandMemory = VK_NULL_HANDLE;
+	VkDeviceSize drawRegionSize;
+	//True if several draws can come from one indirect call, otherwise each batch is drawn one command at a time
+	bool multiDrawIndirect = false;
+	//True if the device can count shader invocations, the GBuffer's fragment shader invocations are then reported
+	bool pipelineStatistics = false;
+	//Depth only pipeline drawn before the GBuffer draws when settings.depthPrePass is set
+	VkPipeline depthPrePassPipeline = VK_NULL_HANDLE;
+	//Compute pipeline that culls the objects and writes the draw commands
+	VkDescriptorSet cullSet;
+	VkPipelineLayout cullPipelineLayout;
+	VkPipeline cullPipeline;
+	void createCullPipeline();
+	//Create the compute version of the subsurface scattering blur, SubsurfacePass owns it
+	void createSubsurfaceComputePipeline();
+	//Record the two raster subsurface scattering passes, the second draws into the swap chain image
+	void recordRasterSubsurface(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame, size_t image);
+	//Record the compute subsurface scattering blur and the pass copying its result into the swap chain image
+	void recordComputeSubsurface(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame, size_t image);
+	//Record the deferred lighting pass, shading the resolved GBuffer into colorImage
+	void recordLightingPass(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame);
+	//Record the lighting's fullscreen draw into the current subpass, its own pass or the GBuffer's second subpass
+	void recordLightingDraw(VkCommandBuffer commandBuffer, uint32_t frame);
+	//Record the single Burley subsurface scattering pass, drawn straight into the swap chain image
+	void recordBurleySubsurface(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame, size_t image);
+	//Offset of a draw command in the draw command buffer, shadow commands follow the GBuffer commands
+	VkDeviceSize drawCommandOffset(uint32_t frame, bool shadow, uint32_t slot) const;
 
 	VkDescriptorPool descriptorPool;
-	std::vector<VkDescriptorSet> descriptorSets;
 	VkDescriptorSet finalRSet;
+	VkDescriptorSet frameSet;
 
 	void createDescriptorPool();
 	void createDescriptorSets();
 
 	//Depth Buffering
+	//Single sample depth/stencil shared by the screen space passes, the stencil marks pixels that skip the subsurface blur
 	VkImage depthImage;
 	VkDeviceMemory depthImageMemory;
 	VkImageView depthImageView;
@@ -312,10 +480,18 @@ private:
 	void createDepthResources();
 	VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 	VkFormat findDepthFormat();
+	//Depth format with a stencil component, used by the screen space passes for the subsurface mask
+	VkFormat findDepthStencilFormat();
 
 	//Custom Objects
 
 	std::vector<VulkanObject*> m_Objects;
+	//Materials shared by the objects, one descriptor set each
+	std::vector<Material*> m_Materials;
+	//Materials by their texture paths, so objects with the same textures share one
+	std::unordered_map<std::string, Material*> m_MaterialLookup;
+	//Returns the material using the given textures, loading it the first time it is asked for
+	Material* getMaterial(const char* texturePath, const char* nTexturePath, const char* sTexturePath);
 
 	VkViewport viewport;
 
@@ -323,25 +499,26 @@ private:
 	void prepareOffscreenRenderpass();
 	void prepareOffscreenFramebuffer();
 	VkPipeline offscreenPipeline;
-	VkPipelineLayout offscreenPipelineLayout; //The pipeline layout
-	std::vector<VkBuffer> offscreenUniforms;
-	std::vector<VkDeviceMemory> offscreenMemorys;
-	std::vector<VkDescriptorSet> offscreenDescSets;
-	std::vector<OffScreenUniformBufferObject> offscreenUBOs;
+	VkPipelineLayout scenePipelineLayout; //The pipeline layout of the shadow and GBuffer passes
 
 	//MSAA
 	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT; //This is set to the highest that the machine it is running on is capable of
 	
-	//Colour, normal, position and death images used for the multisampled version of the GBuffer
+	//Resolved GBuffer, what the lighting and subsurface passes sample
+	//The albedo is resolved into albedoImage, colorImage holds the lit colour written by the lighting pass
+	//Normals are octahedral encoded with the material ID in alpha, positions are rebuilt from the depth in dImage
 	VkImage colorImage;
 	VkDeviceMemory colorImageMemory;
 	VkImageView colorImageView;
+	VkImage albedoImage;
+	VkDeviceMemory albedoImageMemory;
+	VkImageView albedoImageView;
 	VkImage normalImage;
 	VkDeviceMemory normalImageMemory;
 	VkImageView normalImageView;
-	VkImage posImage;
-	VkDeviceMemory posImageMemory;
-	VkImageView posImageView;
+	VkImage motionImage;
+	VkDeviceMemory motionImageMemory;
+	VkImageView motionImageView;
 	VkImage dImage;
 	VkDeviceMemory dImageMemory;
 	VkImageView dImageView;
@@ -362,9 +539,14 @@ private:
 		FrameBufferAttachment *attachment);
 	//! Private CreateGAttachment
 	/*!
-	Creates all the attachments for the GBuffer (Colour, Normal, Specular, Depth).
+	Creates all the attachments for the GBuffer (Motion, Normal, Albedo, Depth).
 	*/
 	void prepareGOffscreenFramebuffer();
+	//! Private prepareLightingFramebuffer
+	/*!
+	Creates the render pass and frame buffer of the lighting pass, which writes the lit colour into colorImage
+	*/
+	void prepareLightingFramebuffer();
 	//! Private CleanGBuffer
 	/*!
 	Cleans up objects and memory related to the GBuffer
@@ -375,8 +557,7 @@ private:
 	Update the descriptor sets used for the GBuffer
 	*/
 	void UpdateGBufferSets();
-	VkBuffer GBUniform;
-	VkDeviceMemory GBUniformMemory;
+	VkDeviceSize GBUniformBlock;
 	GBufferUniformBufferObject GBubo;
 
 	//Subsurface Scattering
@@ -393,6 +574,19 @@ private:
 	float realTime = 0;
 	float timercount = 0;
 	float framecount = 0;
+	//Frames drawn since start, unlike framecount never reset, picks the temporal subsurface phase
+	uint32_t frameIndex = 0;
+	//Number of frames simulated so far, drives the fixed timestep clock when headless
+	uint64_t simulatedFrames = 0;
+	//Update realTime once a frame, from the real clock or the simulated clock when headless
+	void updateClock();
+
+	//GPU pass timings
+	GpuProfiler gpuProfiler;
+	//Query set (command buffer) last submitted by each frame in flight, read back once its fence has signaled
+	std::vector<uint32_t> profiledSets;
+	//Set up the profiler for the graphics queue
+	void createGpuProfiler();
 
 	
 };
\ No newline at end of file
@@ -41,6 +41,11 @@ public:
 	Finds a suitable memory type for storing infomation on the GPU
 	*/
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	//! Public findTransientMemoryType function
+	/*!
+	Finds memory for a transient attachment, lazily allocated where the driver offers it so tilers can keep the attachment on chip, otherwise device local
+	*/
+	uint32_t findTransientMemoryType(uint32_t typeFilter);
 	//! Public beginSingleTimeCommands function
 	/*!
 	Used to start a single use command buffer, mianly use for copying buffers and trasitioning image layouts
@@ -61,22 +66,17 @@ public:
 	Duplicates a buffer by copying one buffer to another
 	*/
 	void copyBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-	//! Public createVertexBuffer function
-	/*!
-	Creates a vertex buffer based on the mesh data stored in a VulkanObject
-	*/
-	void createVertexBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VulkanObject* object);
-	//! Public createIndexBuffer function
+	//! Public createDeviceLocalBuffer function
 	/*!
-	Creates a index buffer based on the mesh data stored in a VulkanObject
+	Creates a device local buffer and fills it with data through a staging buffer
 	*/
-	void createIndexBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VulkanObject* object);
+	void createDeviceLocalBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, const void* source, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
 
 	//Textures
 
 	//! Public createImage function
 	/*!
-	Create a VkImage object using the passed in properties
+	Create a VkImage object using the passed in properties, transient attachments get lazily allocated memory where available
 	*/
 	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, VkSampleCountFlagBits numSamples);
 	//! Public createTextureImage function
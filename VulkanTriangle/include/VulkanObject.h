@@ -20,7 +20,8 @@
 
 
 
-class VulkanEngine;
+class GeometryArena;
+class Material;
 
 /*! Vertex Struct
 Holds the vertex information, main the position and colour.
@@ -73,6 +74,14 @@ namespace std {
 		}
 	};
 }
+/*! Mesh Range struct
+Where a mesh sits in the GeometryArena, passed straight to the indexed draw commands.
+*/
+struct MeshRange {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+};
 //! VulkanObject
 /*!
 Contains all required variables and functions for storing and displaying mesh and texture data (otherwise known as a gameObject or VulkanObject for this)
@@ -92,109 +101,90 @@ private:
 	//! Private boolean.
 	/*! True if the object reseives lighting, if false it is "unlit" and displays the full colour of the albedo texture*/
 	bool m_bLit = true;
+	//! Private boolean.
+	/*! True if the object is drawn into the shadow map*/
+	bool m_bCastsShadow = true;
+	//! Private boolean.
+	/*! True if the object is blurred by the subsurface scattering passes (only when it is also lit)*/
+	bool m_bSubsurface = true;
+	//! Private uint32_t.
+	/*! Diffusion profile the subsurface scattering passes blur the object with, an index into SubsurfacePass::profiles*/
+	uint32_t m_MaterialID = 0;
+	//! Private boolean.
+	/*! True if the transform, lit, shadow, subsurface flag or material ID has changed since ConsumeChanged was last called*/
+	bool m_bChanged = true;
+
+	//! Private vec3 and float.
+	/*! Bounds of the mesh in model space, a box (centre and half size) and a sphere around the same centre*/
+	glm::vec3 m_BoundsCenter = glm::vec3(0, 0, 0);
+	glm::vec3 m_BoundsExtents = glm::vec3(0, 0, 0);
+	float m_BoundsRadius = 0.0f;
 
-	//! Private VulkanEngine pointer.
-	/*! Used to access the vulkan engine for utility functions*/
-	VulkanEngine* m_Engine;
-	//! Private VkDevice reference.
-	/*! Required to create or destroying most vulkan objects */
-	VkDevice& m_Device;
-	
 
-	//! Private VkImage, VkDeviceMemory, VkImageView and VkSampler.
-	/*! Required components for storing the albedo texture */
-	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
-	VkImageView textureImageView;
-	VkSampler textureSampler;
-	//! Private VkImage, VkDeviceMemory, VkImageView and VkSampler.
-	/*! Required components for storing the normal map texture */
-	VkImage ntextureImage;
-	VkDeviceMemory ntextureImageMemory;
-	VkImageView ntextureImageView;
-	VkSampler ntextureSampler;
-	//! Private VkImage, VkDeviceMemory, VkImageView and VkSampler.
-	/*! Required components for storing the specular texture */
-	VkImage stextureImage;
-	VkDeviceMemory stextureImageMemory;
-	VkImageView stextureImageView;
-	VkSampler stextureSampler;
+	//! Private Material pointer.
+	/*! Textures the object is drawn with, shared with other objects and owned by the app */
+	Material* m_Material;
 
 	
 
-	//Vector of vertacies each with a position and colour
+	//Vector of vertacies each with a position and colour, only held while loading
 	std::vector<Vertex> vertices;
-	//Index of each vertex in order to make the pyrimid shapes
+	//Index of each vertex in order to make the pyrimid shapes, only held while loading
 	std::vector<uint32_t> indices;
 
-	//! Private VkBuffer and VkDeviceMemory.
-	/*! Required components for storing vertex infomation */
-	VkBuffer m_VertexBuffer;
-	VkDeviceMemory m_VertexBufferMemory;
-	//! Private VkBuffer and VkDeviceMemory.
-	/*! Required components for storing vertex indecies */
-	VkBuffer m_IndexBuffer;
-	VkDeviceMemory m_IndexBufferMemory;
+	//! Private MeshRange.
+	/*! Where the mesh was packed into the geometry arena */
+	MeshRange m_Mesh = {};
 
 public:
 	//! VulkanObject Contructor
 	/*!
-	Sets up the VulkanObject included creating texture objects
-	\param engine VulkanEngine*, pointer to the vulkan engine
-	\param device VkDevice&, logical device referance
-	\param graphicsQueue VkQueue, the graphics queue used to render this object
-	\param VkCommandPool commandPool, used in the processes for creating objects related to textures
+	Sets up the VulkanObject, loading the mesh and adding it to the geometry arena
+	\param arena GeometryArena*, arena holding the vertex and index data of every object
 	\param modelPath const char*, text path to the mesh data file
-	\param texturePath const char*, text path to the albedo texture file
-	\param nTexturePath const char*, text path to the normal texture file
-	\param sTexturePath const char*, text path to the specular texture file
+	\param material Material*, textures to draw the object with
 	*/
-	VulkanObject(VulkanEngine* engine, VkDevice& device, VkQueue graphicsQueue, VkCommandPool commandPool, const char* modelPath, const char* texturePath, const char* nTexturePath, const char* sTexturePath);
-	//! VulkanObject Decontructor
-	/*!
-	Cleans up memory and objects in class
-	*/
-	~VulkanObject();
+	VulkanObject(GeometryArena* arena, const char* modelPath, Material* material);
 
 	
-	//! Public Get and Set functions
+	//! Public GetMesh function
 	/*! 
-	Functions for getting and settings vertecies, indecies, buffers and memory
+	Returns where the object's vertices and indices are in the geometry arena
 	*/
-	VkBuffer& GetVertexBuffer() { return m_VertexBuffer; }
-	VkBuffer& GetIndexBuffer() { return m_IndexBuffer; }
-	const std::vector<uint32_t>& GetIndices() { return indices; }
-	const std::vector<Vertex>& GetVertices() { return vertices; }
-	VkDeviceMemory& GetVertexMemory() { return m_VertexBufferMemory; }
-	VkDeviceMemory& GetIndexMemory() { return m_IndexBufferMemory; }
+	const MeshRange& GetMesh() const { return m_Mesh; }
 
 	//! Public Get and Set functions.
 	/*!
 	Functions for getting and setting transform infomation (position, rotation and scale)
 	*/
-	const void SetPos(glm::vec3 pos) { m_Position = pos; }
+	const void SetPos(glm::vec3 pos) { m_Position = pos; m_bChanged = true; }
 	const glm::vec3 GetPos() const { return m_Position; }
-	const void SetRot(glm::vec3 rot) { m_Rotation = rot; }
+	const void SetRot(glm::vec3 rot) { m_Rotation = rot; m_bChanged = true; }
 	const glm::vec3 GetRot() const { return m_Rotation; }
-	const void SetScale(glm::vec3 scale) { m_Scale = scale; }
+	const void SetScale(glm::vec3 scale) { m_Scale = scale; m_bChanged = true; }
 	const glm::vec3 GetScale() const { return m_Scale; }
 
-	//! Public Get and Set functions.
+	//! Public GetModelMatrix function.
 	/*!
-	Functions for getting and setting objects related to the albedo texture
+	Returns the model matrix (translation, rotation and scale), objects with a y rotation spin by that many degrees a second
+	\param time float, seconds since the app started
 	*/
-	VkImage& GetTextureImage() { return textureImage; }
-	void SetTextureImageView(VkImageView view) { textureImageView = view; }
-	VkImageView& GetTextureImageView() { return textureImageView; }
-	VkSampler& GetTextureSampler() { return textureSampler; }
-	//! Public Get functions.
+	glm::mat4 GetModelMatrix(float time) const;
+	//! Public GetWorldBounds function.
 	/*!
-	Functions for getting objects related to the normal texture
+	Transform the model space bounds by a model matrix
+	\param model mat4, the object's model matrix
+	\param center vec3&, set to the world space centre
+	\param extents vec3&, set to the half size of a world space box around the transformed box
+	\param radius float&, set to the world space sphere radius
 	*/
-	VkImageView& GetNormalTextureImageView() { return ntextureImageView; }
-	VkSampler& GetNormalTextureSampler() { return ntextureSampler; }
-	VkImageView& GetSpecTextureImageView() { return stextureImageView; }
-	VkSampler& GetSpecTextureSampler() { return stextureSampler; }
+	void GetWorldBounds(const glm::mat4& model, glm::vec3& center, glm::vec3& extents, float& radius) const;
+
+	//! Public GetMaterial function.
+	/*!
+	Returns the material (textures and descriptor set) the object is drawn with
+	*/
+	Material* GetMaterial() const { return m_Material; }
 
 	//! Public Lit function.
 	/*!
@@ -205,7 +195,42 @@ public:
 	/*!
 	Set to true for the object to be effected by lighting
 	*/
-	const void SetLit(bool lit) { m_bLit = lit; }
+	const void SetLit(bool lit) { m_bLit = lit; m_bChanged = true; }
+	//! Public Subsurface function.
+	/*!
+	Returns true if the object is marked for subsurface scattering
+	*/
+	const bool Subsurface() const { return m_bSubsurface; }
+	//! Public SetSubsurface function.
+	/*!
+	Set to false for the screen space passes to copy the object instead of blurring it
+	*/
+	const void SetSubsurface(bool subsurface) { m_bSubsurface = subsurface; m_bChanged = true; }
+	//! Public MaterialID function.
+	/*!
+	Returns the diffusion profile the object is blurred with
+	*/
+	const uint32_t MaterialID() const { return m_MaterialID; }
+	//! Public SetMaterialID function.
+	/*!
+	Set the diffusion profile the object is blurred with, below MAX_PROFILES
+	*/
+	const void SetMaterialID(uint32_t materialID) { m_MaterialID = materialID; m_bChanged = true; }
+	//! Public CastsShadow function.
+	/*!
+	Returns true if the object is drawn into the shadow map
+	*/
+	const bool CastsShadow() const { return m_bCastsShadow; }
+	//! Public SetCastsShadow function.
+	/*!
+	Set to false to leave the object out of the shadow pass
+	*/
+	const void SetCastsShadow(bool castsShadow) { m_bCastsShadow = castsShadow; m_bChanged = true; }
+	//! Public ConsumeChanged function.
+	/*!
+	Returns true if the transform, lit, shadow, subsurface flag or material ID has changed since the last call, then clears the flag
+	*/
+	const bool ConsumeChanged() { bool changed = m_bChanged; m_bChanged = false; return changed; }
 
 	
 	//! Public loadModel function.
@@ -1,12 +1,12 @@
-
 #include <VulkanApp.h>
 #include <iostream>
-int main() {
-	//Create app
-	VulkanApp* app = new VulkanApp();
-
-	//Try to run the app or exit with an error
+int main(int argc, char** argv) {
+	//Try to read the settings, create the app and run it or exit with an error
 	try {
+		AppSettings settings = AppSettings::FromCommandLine(argc, argv);
+
+		//Create app
+		VulkanApp* app = new VulkanApp(settings);
 		app->run();
 	}
 	catch (const std::exception& e) {
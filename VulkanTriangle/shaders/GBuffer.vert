@@ -1,17 +1,34 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+struct ObjectData {
+	mat4 model;
+	vec4 lit;
+	vec4 sphere;
+	vec4 extents;
+	uvec4 mesh;
+	mat4 prevModel;
+};
+
+//Every object's data, the draw's first instance is the object's index
+layout(set = 1, binding = 2) readonly buffer Objects {
+	ObjectData objects[];
+};
+
+layout(set = 1, binding = 0) uniform FrameUniformBufferObject {
     mat4 view;
     mat4 proj;
 	mat4 lightrot;
-	mat4 lightSpace;
 	mat4 lightViewProj;
 	
 	vec4 AmbientColour;
 	vec4 DirectionalColour;
-} ubo;
+
+	vec4 cameraPlanes[6];
+	vec4 shadowPlanes[6];
+
+	mat4 prevViewProj;
+} frame;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
@@ -20,37 +37,26 @@ layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragNormal;
 layout(location = 1) out vec2 fragTexCoord;
-layout (location = 4) out vec4 outShadowCoord;
 layout(location = 5) out vec3 fragPos;
-layout(location = 6) out int enableLighting;
+layout(location = 6) out flat vec2 MaterialFlags; //x 1 if lit, y 1 if subsurface scattered
 
-layout(location = 7) out vec4 AmbientColour;
-layout(location = 8) out vec4 DirectionalColour;
-layout(location = 9) out vec4 FragmentPosition;
-layout(location = 10) out mat4 LightViewProj;
+layout(location = 13) out vec4 CurrentClip;
+layout(location = 14) out vec4 PreviousClip; //Where the surface was on screen last frame, the motion reprojects the subsurface history
+layout(location = 15) out flat float MaterialID; //Diffusion profile of the subsurface blur
 
-vec3 lDir = vec3(-0.0f, -0.015f, 15.f);
-layout(location = 2) out vec3 lightDir;
-
-const mat4 bias = mat4( 
-	0.5, 0.0, 0.0, 0.0,
-	0.0, 0.5, 0.0, 0.0,
-	0.0, 0.0, 1.0, 0.0,
-	0.5, 0.5, 0.0, 1.0 );
+//Matches the depth pre-pass exactly, the GBuffer is drawn with an equal depth test after it
+invariant gl_Position;
 
 void main() {
 
-	lDir = lDir * mat3(ubo.lightrot); //Calucate the light position
-	lightDir = normalize(vec3(0, -0.0, 0)- lDir);  //Calculate the light direction
+	ObjectData ubo = objects[gl_InstanceIndex];
 	fragNormal = mat3(transpose(inverse(ubo.model))) * inNormal; //Calculate the normal
-	vec4 pos = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);//Calculate the position
+	vec4 pos = frame.proj * frame.view * ubo.model * vec4(inPosition, 1.0);//Calculate the position
 	fragPos =  (ubo.model * vec4(inPosition, 1.0)).xyz;
 	gl_Position = pos;
-	FragmentPosition = ubo.model * vec4(inPosition, 1.0);
+	CurrentClip = pos;
+	PreviousClip = frame.prevViewProj * ubo.prevModel * vec4(inPosition, 1.0);
 	fragTexCoord = inTexCoord; //Pass out the texture coords
-	outShadowCoord = ( bias * ubo.lightSpace) * vec4(inPosition, 1.0);	//Calculate the shadow coords using a bias
-	
-	AmbientColour = ubo.AmbientColour;
-	DirectionalColour = ubo.DirectionalColour;
-	LightViewProj = mat4(ubo.lightViewProj);
+	MaterialFlags = ubo.lit.xy; //Lighting itself is left to the lighting pass
+	MaterialID = ubo.lit.z;
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+#define MAX_SAMPLES	25
+#define MAX_PROFILES	4
+#define ADAPTIVE_TIERS	3
+#define ADAPTIVE_TAPS	35
+#define BURLEY_SAMPLES	17
+#define EDGE_LERP_SCALE 300.0f
+#define FOVY 0.785398
+#define GOLDEN_ANGLE 2.39996323 //Turn between consecutive taps, spreads them evenly over the disk at any count
+
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(binding = 1) uniform sampler2D colourSampler;
+layout(binding = 2) uniform usampler2D depthSampler; //Bits of the float depth
+layout(binding = 4) uniform usampler2D normSampler; //Material ID in alpha
+
+layout(location = 0) out vec4 outColor;
+
+//Set when the depth is packed into the colour's alpha, each tap is then one fetch
+layout(constant_id = 3) const bool PACKED_DEPTH = false;
+
+layout(set = 1, binding = 0) uniform FrameUniformBufferObject {
+	mat4 view;
+	mat4 proj;
+	mat4 lightrot;
+	mat4 lightViewProj;
+
+	vec4 AmbientColour;
+	vec4 DirectionalColour;
+
+	vec4 cameraPlanes[6];
+	vec4 shadowPlanes[6];
+
+	mat4 prevViewProj;
+	vec4 temporal; //x frame index
+} frame;
+
+layout (set = 1, binding = 1) uniform KernelUniformBufferObject
+{
+	vec4 kernel[MAX_PROFILES * MAX_SAMPLES];
+	vec4 adaptiveKernel[MAX_PROFILES * ADAPTIVE_TAPS];
+	vec4 adaptiveTiers[ADAPTIVE_TIERS];
+	vec4 burleyKernel[MAX_PROFILES * BURLEY_SAMPLES]; //Per profile the centre, then rgb weight and radius (a) of each disk tap from the nearest out
+} kern;
+
+//Nearest texel of an integer GBuffer target, these cannot be filtered
+uvec4 fetchGBuffer(usampler2D target, vec2 texCoord)
+{
+	ivec2 size = textureSize(target, 0);
+	return texelFetch(target, clamp(ivec2(texCoord * vec2(size)), ivec2(0), size - 1), 0);
+}
+
+//Colour in rgb and depth in a
+vec4 fetchTap(vec2 texCoord)
+{
+	if (PACKED_DEPTH)
+	{
+		vec4 colour = texture(colourSampler, texCoord);
+		return vec4(colour.rgb, colour.a >= 0.5 ? colour.a - 1.0 : -colour.a);
+	}
+	return vec4(texture(colourSampler, texCoord).rgb, uintBitsToFloat(fetchGBuffer(depthSampler, texCoord).r));
+}
+
+//Interleaved gradient noise, close to blue noise without needing a texture
+float gradientNoise(vec2 pixel)
+{
+	return fract(52.9829189 * fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+}
+
+void main() {
+	vec4 colorM = texture(colourSampler, fragTexCoord);
+
+	//Pixels without subsurface scattering are copied, the flag (or packed depth) is at least 0.5 where it is
+	if (colorM.a < 0.5) {
+		outColor = vec4(colorM.rgb, 1);
+		return;
+	}
+	float depthM = fetchTap(fragTexCoord).a;
+
+	float subsurfWidth = 0.01; //Fixed width, same as the separable blur
+	float dist = 1.0 / tan(0.5 * FOVY); //Calculate distance to projection window
+	float scale = subsurfWidth * dist / depthM / 2; //Texture space per kernel unit
+
+	//Diffusion profile of this pixel's material
+	int first = clamp(int(fetchGBuffer(normSampler, fragTexCoord).a), 0, MAX_PROFILES - 1) * BURLEY_SAMPLES;
+
+	vec3 colorBlurred = colorM.rgb * kern.burleyKernel[first].rgb; //Set centre pixel value
+
+	//Each pixel turns the disk by its own noise, moved on every frame, so the few taps give fine grain rather than rings
+	float rotation = 6.2831853 * fract(gradientNoise(gl_FragCoord.xy) + 0.618034 * frame.temporal.x);
+	for (int i = 1; i < BURLEY_SAMPLES; i++)
+	{
+		vec4 k = kern.burleyKernel[first + i];
+		float angle = rotation + float(i) * GOLDEN_ANGLE;
+		vec2 sampleTexCoord = fragTexCoord + k.a * scale * vec2(cos(angle), sin(angle));
+		vec4 tap = fetchTap(sampleTexCoord);
+
+		//Lerp back to the centre colour based on the diffrence in depth, to avoid blurring over edges
+		float s = clamp(EDGE_LERP_SCALE * dist * subsurfWidth * abs(depthM - tap.a), 0.0f, 1.0f);
+		colorBlurred += k.rgb * mix(tap.rgb, colorM.rgb, s); //The importance sampling is already in the weights
+	}
+
+	outColor = vec4(colorBlurred, 1);
+}
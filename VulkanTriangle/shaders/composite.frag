@@ -0,0 +1,28 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 1) in vec2 fragTexCoord;
+
+//Result of the compute blur
+layout(binding = 1) uniform sampler2D colourSampler;
+//GBuffer colour with the subsurface flag in alpha
+layout(binding = 3) uniform sampler2D gbufferSampler;
+
+//Set when the blur only ran on tiles with subsurface pixels, the rest of the result was never written
+layout(constant_id = 0) const bool TILED = false;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	if (TILED)
+	{
+		vec4 colour = texture(gbufferSampler, fragTexCoord);
+		if (colour.a < 0.5)
+		{
+			outColor = vec4(colour.rgb, 1);
+			return;
+		}
+	}
+
+	outColor = vec4(texture(colourSampler, fragTexCoord).rgb, 1);
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#version 450
+
+//Only the position is read, the pre-pass pipeline binds no other attribute
+layout(location = 0) in vec3 inPosition;
+
+struct ObjectData {
+	mat4 model;
+	vec4 lit;
+	vec4 sphere;
+	vec4 extents;
+	uvec4 mesh;
+	mat4 prevModel;
+};
+
+//Every object's data, the draw's first instance is the object's index
+layout(set = 1, binding = 2) readonly buffer Objects {
+	ObjectData objects[];
+};
+
+layout (set = 1, binding = 0) uniform FrameUniformBufferObject 
+{
+	mat4 view;
+	mat4 proj;
+	mat4 lightrot;
+	mat4 lightViewProj;
+	vec4 AmbientColour;
+	vec4 DirectionalColour;
+} frame;
+
+//The GBuffer pass tests for equal depth, so the position is worked out exactly as GBuffer.vert does
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = frame.proj * frame.view * objects[gl_InstanceIndex].model * vec4(inPosition, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout (set = 0, binding = 0) uniform GBufferUniformBufferObject 
+{
+	vec2 blurDirection;
+} ubo;
+
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec2 blurDir;
+
+void main() {
+
+	//One triangle covering the screen, vertex 0 (0,0), 1 (2,0) and 2 (0,2) in texture space
+	fragTexCoord = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(fragTexCoord * 2.0 - 1.0, 0.0, 1.0); //The part outside the screen is clipped
+	blurDir = ubo.blurDirection;
+}
\ No newline at end of file
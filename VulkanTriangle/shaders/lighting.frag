@@ -0,0 +1,236 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+#define MAX_PCF_TAPS 16
+#define PCF_RADIUS 1.5 //Widest hardware filtered tap offset in shadow map texels
+#define SHADOW_BIAS 0.005
+
+layout(location = 1) in vec2 fragTexCoord;
+
+#ifdef SUBPASS_INPUT
+//Built as fragLightingSubpass.spv, the second subpass of the GBuffer render pass. Only this pixel of the GBuffer is read
+layout(input_attachment_index = 0, binding = 1) uniform subpassInput albedoInput;
+layout(input_attachment_index = 1, binding = 2) uniform usubpassInput depthInput; //Bits of the float depth
+layout(input_attachment_index = 2, binding = 4) uniform usubpassInput normInput; //Octahedral encoded in rg, flags in b, see GBuffer.frag
+#define READ_ALBEDO() subpassLoad(albedoInput)
+#define READ_DEPTH() uintBitsToFloat(subpassLoad(depthInput).r)
+#define READ_SURFACE() subpassLoad(normInput)
+#else
+//The integer targets cannot be filtered, the lighting runs at their resolution so each pixel fetches its own texel
+layout(binding = 1) uniform sampler2D albedoSampler;
+layout(binding = 2) uniform usampler2D depthSampler; //Bits of the float depth
+layout(binding = 4) uniform usampler2D normSampler; //Octahedral encoded in rg, flags in b, see GBuffer.frag
+#define READ_ALBEDO() texture(albedoSampler, fragTexCoord)
+#define READ_DEPTH() uintBitsToFloat(texelFetch(depthSampler, ivec2(gl_FragCoord.xy), 0).r)
+#define READ_SURFACE() texelFetch(normSampler, ivec2(gl_FragCoord.xy), 0)
+#endif
+layout(binding = 3) uniform sampler2D shadowMap;
+layout(binding = 5) uniform sampler2DShadow shadowCompare; //The shadow map again, compared by the sampler
+
+layout(location = 0) out vec4 outColor;
+
+//Shadow filter, 0 a single read, 1 a 3x3 grid of reads, 2 a Poisson disk and 3 a rotated grid of compared taps
+layout (constant_id = 0) const int enablePCF = 0;
+//The subsurface blur reads its depth from the colour's alpha, 1 + depth for subsurface pixels and -depth for the rest
+layout (constant_id = 1) const bool packDepth = false;
+//Taps of the Poisson disk or rotated grid, the grid takes 4, 9 or 16
+layout (constant_id = 2) const int PCF_TAPS = 9;
+
+layout(set = 1, binding = 0) uniform FrameUniformBufferObject {
+	mat4 view;
+	mat4 proj;
+	mat4 lightrot;
+	mat4 lightViewProj;
+
+	vec4 AmbientColour;
+	vec4 DirectionalColour;
+
+	vec4 cameraPlanes[6];
+	vec4 shadowPlanes[6];
+
+	mat4 prevViewProj;
+	vec4 temporal;
+	mat4 invViewProj; //Takes a pixel and its depth back to world space
+} frame;
+
+const vec2 poissonDisk[MAX_PCF_TAPS] = vec2[](
+	vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725), vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+	vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464), vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+	vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420), vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+	vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590), vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790) );
+
+const mat4 bias = mat4(
+	0.5, 0.0, 0.0, 0.0,
+	0.0, 0.5, 0.0, 0.0,
+	0.0, 0.0, 1.0, 0.0,
+	0.5, 0.5, 0.0, 1.0 );
+
+vec3 lightDir;
+
+vec3 octDecode(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+//Project the shadow texture to check if a fragment is visable from the lights perspective
+float textureProj(vec4 shadowCoord, vec2 off)
+{
+	float shadow = 1.0;
+	if ( shadowCoord.z > -1.0 && shadowCoord.z < 1.0 )
+	{
+		float dist = texture( shadowMap, shadowCoord.st + off ).r;
+		if ( shadowCoord.w > 0.0 && dist < shadowCoord.z )
+		{
+			shadow = 0.35;
+		}
+	}
+	return shadow;
+}
+
+//Itterate through surrounding pixel to get an avarage value
+float filterPCF(vec4 shadowCoords)
+{
+	 ivec2 textureDimensions = textureSize(shadowMap, 0);
+	 float scale = 0.5;
+	 float deltaX = scale * 1.0 / float(textureDimensions.x);
+	 float deltaY = scale * 1.0 / float(textureDimensions.y);
+
+	 float shadowFactor = 0.0;
+	 int count = 0;
+	 int range = enablePCF == 1 ? 1 : 0;
+	 float bias = 0.005;
+
+	 for (int x = -range; x <= range; x++)
+	 {
+		 for (int y = -range; y <= range; y++)
+		 {
+			 float factor = textureProj(shadowCoords, vec2(deltaX*x, deltaY*y));
+			 shadowFactor += shadowCoords.z - bias > factor ? 0.0 : 1.0;
+			 count++;
+		 }
+	 }
+	 return (shadowFactor) / count;
+}
+
+//Each tap is compared by the sampler and bilinearly filtered, so returns the lit fraction of the 2x2 texels around it
+float filterHardware(vec4 shadowCoords)
+{
+	if (shadowCoords.z <= -1.0 || shadowCoords.z >= 1.0)
+		return 1.0;
+
+	vec2 texel = PCF_RADIUS / vec2(textureSize(shadowCompare, 0));
+	float reference = shadowCoords.z - SHADOW_BIAS;
+	float lit = 0.0;
+	int count = 0;
+
+	if (enablePCF == 2)
+	{
+		//Turned by a per pixel angle so the disk's pattern shows as noise rather than banding
+		float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+		mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+		for (int i = 0; i < min(PCF_TAPS, MAX_PCF_TAPS); i++)
+		{
+			lit += texture(shadowCompare, vec3(shadowCoords.xy + rotation * poissonDisk[i] * texel, reference));
+			count++;
+		}
+	}
+	else
+	{
+		//Square grid turned by atan(1/2), no two taps then share a row or column of texels
+		const mat2 rotation = mat2(0.89442719, 0.44721360, -0.44721360, 0.89442719);
+		int side = PCF_TAPS >= 16 ? 4 : (PCF_TAPS >= 9 ? 3 : 2);
+		float extent = 0.5 * float(side - 1);
+		for (int y = 0; y < side; y++)
+		{
+			for (int x = 0; x < side; x++)
+			{
+				vec2 offset = (vec2(x, y) - extent) / extent;
+				lit += texture(shadowCompare, vec3(shadowCoords.xy + rotation * offset * texel, reference));
+				count++;
+			}
+		}
+	}
+	return lit / float(count);
+}
+
+float dist(vec3 posW, vec3 normalW, vec4 shadowCoord) {
+
+	float distToLight = length(-lightDir - posW);
+	vec3 shadowCoords = shadowCoord.xyz/shadowCoord.w;
+	// Fetch depth from the shadow map:
+	vec4 d1 = texture(shadowMap, shadowCoords.xy*0.5+0.5);
+	vec3 Ni = lightDir; //The side the light enters faces it, the object's own normal map is not bound here
+
+	d1 = d1*0.95;
+
+	float backFacingEst = clamp(-dot( Ni, normalW ), 0.0, 1.0);
+	float thickness = distToLight - d1.x;
+	float nDotL1 = dot(normalW, lightDir);
+	if(nDotL1 > 0.0)
+	{
+		thickness = -50.0;
+	}
+	float correctThickness = clamp(-nDotL1, 0.0,1.0)*thickness;
+	float finalThickness = mix(thickness, correctThickness, backFacingEst);
+	return finalThickness;
+
+}
+
+//Three-Layer Skin
+vec3 T(float scaledDist) {
+	float dd = -scaledDist* scaledDist;
+
+	return	vec3(0.233f, 0.455f, 0.649f) * exp(dd / 0.0064f) +
+			vec3(0.1f,   0.336f, 0.344f) * exp(dd / 0.0484f) +
+			vec3(0.118f, 0.198f, 0.0f)   * exp(dd / 0.187f)  +
+			vec3(0.113f, 0.007f, 0.007f) * exp(dd / 0.567f)  +
+			vec3(0.358f, 0.004f, 0.0f)   * exp(dd / 1.99f)   +
+			vec3(0.078f, 0.0f,   0.0f)   * exp(dd / 7.41f);
+}
+
+//Runs once per pixel on the resolved GBuffer, however many surfaces were drawn over it
+void main() {
+	vec4 col = READ_ALBEDO();
+	uvec4 surface = READ_SURFACE();
+	float depth = READ_DEPTH();
+
+	//Unlit pixels and the background keep their albedo, they are not subsurface scattered
+	if ((surface.b & 1u) == 0u)
+	{
+		outColor = vec4(col.rgb, packDepth ? -depth : 0.0);
+		return;
+	}
+	bool subsurface = (surface.b & 2u) != 0u;
+	float specIntensity = float(surface.b >> 2) / 255.0;
+
+	vec3 norm = octDecode(vec2(surface.rg) / 1023.0);
+	vec4 world = frame.invViewProj * vec4(fragTexCoord * 2.0 - 1.0, depth, 1.0);
+	vec3 fragPos = world.xyz / world.w;
+	vec4 shadowCoord = bias * frame.lightViewProj * vec4(fragPos, 1.0);
+
+	vec3 lDir = vec3(-0.0f, -0.015f, 15.f) * mat3(frame.lightrot); //Calucate the light position
+	lightDir = normalize(-lDir); //Calculate the light direction
+
+	float s = dist(fragPos, norm, shadowCoord) * 2.0;
+	float irradiance = clamp(0.3f + dot(lightDir, -norm), 0.f, 1.f);
+
+	float diff = max(dot(lightDir, norm), 0.0); //Calulate lamberisan
+	vec3 diffuse = frame.DirectionalColour.rgb * diff; //Calculate diffuse light
+
+	vec3 viewDir = normalize(vec3(0.0f, 0.0f, 0.5f) - fragPos);
+	vec3 halfwayDir = normalize(normalize(lightDir) + viewDir);
+	float spec = pow(max(0.0, dot(norm, halfwayDir)), 16) * (specIntensity * 0.25);
+	diffuse += vec3(1,1,1) * spec;
+
+	float shadow = enablePCF >= 2 ? filterHardware(shadowCoord / shadowCoord.w) : filterPCF(shadowCoord / shadowCoord.w); //Calculate shadow value
+	diffuse *= shadow;
+
+	outColor.rgb = (frame.AmbientColour.rgb * col.rgb) + diffuse * col.rgb + clamp(s * (T(s) * frame.DirectionalColour.rgb * col.rgb * irradiance), 0, 1);
+	outColor.a = subsurface ? 1.0 : 0.0; //Subsurface flag, the screen space passes mask on it
+	if (packDepth)
+		outColor.a = subsurface ? 1.0 + depth : -depth; //Still at least 0.5 only where subsurface scattered
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 1) in vec2 fragTexCoord;
+
+//Colour with the subsurface flag in alpha
+layout(binding = 1) uniform sampler2D colourSampler;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	vec4 colour = texture(colourSampler, fragTexCoord);
+
+	//Subsurface pixels are left for the blur, their stencil is not written
+	if (colour.a >= 0.5)
+		discard;
+
+	outColor = colour; //Flag kept so the vertical pass can mask on the horizontal result
+}
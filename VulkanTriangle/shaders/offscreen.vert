@@ -4,10 +4,29 @@ layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
 
-layout (binding = 0) uniform OffScreenUniformBufferObject 
+struct ObjectData {
+	mat4 model;
+	vec4 lit;
+	vec4 sphere;
+	vec4 extents;
+	uvec4 mesh;
+	mat4 prevModel;
+};
+
+//Every object's data, the draw's first instance is the object's index
+layout(set = 1, binding = 2) readonly buffer Objects {
+	ObjectData objects[];
+};
+
+layout (set = 1, binding = 0) uniform FrameUniformBufferObject 
 {
-	mat4 depthMVP;
-} ubo;
+	mat4 view;
+	mat4 proj;
+	mat4 lightrot;
+	mat4 lightViewProj;
+	vec4 AmbientColour;
+	vec4 DirectionalColour;
+} frame;
 
 out gl_PerVertex 
 {
@@ -17,5 +36,5 @@ out gl_PerVertex
  
 void main()
 {
-	gl_Position =  ubo.depthMVP * vec4(inPosition, 1.0);
+	gl_Position =  frame.lightViewProj * objects[gl_InstanceIndex].model * vec4(inPosition, 1.0);
 }
\ No newline at end of file
@@ -1,6 +1,18 @@
-C:/VulkanSDK/1.1.97.0/Bin32/glslangValidator.exe -V shader.vert
-C:/VulkanSDK/1.1.97.0/Bin32/glslangValidator.exe -V shader.frag
-C:/VulkanSDK/1.1.97.0/Bin32/glslangValidator.exe -V base.vert
-C:/VulkanSDK/1.1.97.0/Bin32/glslangValidator.exe -V base.frag
-C:/VulkanSDK/1.1.97.0/Bin32/glslangValidator.exe -V shader.geom
-pause
\ No newline at end of file
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V GBuffer.vert -o GBVert.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V GBuffer.frag -o GBFrag.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V fullscreen.vert -o vertFS.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V shader.frag -o fragR.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V offscreen.vert -o vertOff.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V offscreen.frag -o fragOff.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V cull.comp -o cull.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V sss_blur.comp -o sssBlur.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V composite.frag -o fragComposite.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V mask.frag -o fragMask.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V upsample.frag -o fragUpsample.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V sss_classify.comp -o sssClassify.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V sss_tile_blur.comp -o sssTileBlur.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V burley.frag -o fragBurley.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V lighting.frag -o fragLighting.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V depth.vert -o vertDepth.spv
+"%VULKAN_SDK%\Bin\glslangValidator.exe" -V -DSUBPASS_INPUT lighting.frag -o fragLightingSubpass.spv
+pause
@@ -1,58 +1,189 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-#define NUM_SAMPLES	25
+#define MAX_SAMPLES	25
+#define MAX_PROFILES	4
+#define ADAPTIVE_TIERS	3
+#define ADAPTIVE_TAPS	35
+#define KERNEL_RANGE 2.0 //Offset of the last tap in kernel units
 #define EDGE_LERP_SCALE 300.0f
 #define FOVY 0.785398
+#define HISTORY_DEPTH_TOLERANCE 0.01f //Fraction of the view distance
 
 layout(location = 1) in vec2 fragTexCoord;
 
 layout(binding = 1) uniform sampler2D colourSampler;
-layout(binding = 2) uniform sampler2D normSampler;
+layout(binding = 2) uniform usampler2D depthSampler; //Bits of the float depth
+layout(binding = 3) uniform sampler2D historySampler; //Last frame's accumulated result, only read when accumulating
+layout(binding = 4) uniform usampler2D normSampler; //Material ID in alpha
+layout(binding = 5) uniform sampler2D motionSampler; //Offset to where each pixel was last frame, only read when accumulating
 
 layout(location = 0) out vec4 outColor;
 
 layout(location = 2) in vec2 blurDir;
-layout(location = 3) in vec4 kernel[NUM_SAMPLES];
 
+//Number of taps used, set when the pipeline is created
+layout(constant_id = 0) const int NUM_SAMPLES = MAX_SAMPLES;
+//Each frame only takes every TEMPORAL_PHASES'th tap, the history fills in the rest
+layout(constant_id = 1) const int TEMPORAL_PHASES = 1;
+//Set for the vertical pass writing the history
+layout(constant_id = 2) const bool ACCUMULATE = false;
+//Set when the depth is packed into the colour's alpha, each tap is then one fetch
+layout(constant_id = 3) const bool PACKED_DEPTH = false;
+//Set to pick a smaller kernel where the projected kernel is only a few pixels wide
+layout(constant_id = 4) const bool ADAPTIVE = false;
 
+layout(set = 1, binding = 0) uniform FrameUniformBufferObject {
+	mat4 view;
+	mat4 proj;
+	mat4 lightrot;
+	mat4 lightViewProj;
+	
+	vec4 AmbientColour;
+	vec4 DirectionalColour;
+
+	vec4 cameraPlanes[6];
+	vec4 shadowPlanes[6];
+
+	mat4 prevViewProj;
+	vec4 temporal; //x frame index, y phases, z weight of the current frame, w 1 when the history is valid
+	mat4 invViewProj;
+} frame;
+
+//Read directly rather than passed down from the vertex shader.
+//With --sss-bilinear each tap past the centre may be two merged taps, the linear sampler blends them at the weighted offset
+layout (set = 1, binding = 1) uniform KernelUniformBufferObject 
+{
+	vec4 kernel[MAX_PROFILES * MAX_SAMPLES]; //One kernel per diffusion profile
+	vec4 adaptiveKernel[MAX_PROFILES * ADAPTIVE_TAPS]; //The smaller kernels one after another, each centre first, repeated per profile
+	vec4 adaptiveTiers[ADAPTIVE_TIERS]; //x first entry, y tap count (0 if unused), z widest projected kernel in pixels, smallest first
+} kern;
+
+//Set in main, the kernel this pixel blurs with
+int kernelProfile = 0;
+int kernelFirst = 0;
+bool kernelAdaptive = false;
+
+vec4 kernelTap(int i)
+{
+	return kernelAdaptive ? kern.adaptiveKernel[kernelProfile * ADAPTIVE_TAPS + kernelFirst + i] : kern.kernel[kernelProfile * MAX_SAMPLES + i];
+}
+
+//Nearest texel of an integer GBuffer target, these cannot be filtered
+uvec4 fetchGBuffer(usampler2D target, vec2 texCoord)
+{
+	ivec2 size = textureSize(target, 0);
+	return texelFetch(target, clamp(ivec2(texCoord * vec2(size)), ivec2(0), size - 1), 0);
+}
+
+//View distance of a depth buffer value, this frame and last share the projection
+float linearDepth(float depth)
+{
+	return frame.proj[3][2] / (depth + frame.proj[2][2]);
+}
+
+//Colour in rgb and depth in a
+vec4 fetchTap(vec2 texCoord)
+{
+	if (PACKED_DEPTH)
+	{
+		vec4 colour = texture(colourSampler, texCoord);
+		return vec4(colour.rgb, colour.a >= 0.5 ? colour.a - 1.0 : -colour.a);
+	}
+	return vec4(texture(colourSampler, texCoord).rgb, uintBitsToFloat(fetchGBuffer(depthSampler, texCoord).r));
+}
 
 void main() {
 	
 	
 	///////////////////////////////////////////////////
 	vec4 colorM = texture(colourSampler, fragTexCoord);
-	vec4 normalM = texture(normSampler, fragTexCoord);
+	float depthM = fetchTap(fragTexCoord).a;
 
-	if (normalM.a == 0.00f) { 
+	if (depthM == 0.00f) { 
 		outColor = vec4(colorM.rgb, 1);
 		return; 
 	} 
 	
-	float depthM = normalM.a;//Sample depth stored in alpha channel of the normal texture
 	float subsurfWidth = 0.01;//Fixed width, could be sampled from a texture
 
 	float dist = 1.0 / tan(0.5 * FOVY); //Calculate distance to projection window
     float scale = dist / depthM / 2; 
     vec2 offset = subsurfWidth * scale * blurDir; //Final step for each sample
+
+	//Diffusion profile of this pixel's material
+	kernelProfile = clamp(int(fetchGBuffer(normSampler, fragTexCoord).a), 0, MAX_PROFILES - 1);
+
+	//Distant faces only cover a few pixels, use the smallest kernel that still has a tap for about every pixel
+	int tapCount = NUM_SAMPLES;
+	if (ADAPTIVE)
+	{
+		float width = KERNEL_RANGE * length(offset * vec2(textureSize(colourSampler, 0)));
+		for (int t = 0; t < ADAPTIVE_TIERS; t++)
+		{
+			if (kern.adaptiveTiers[t].y > 0.0 && width <= kern.adaptiveTiers[t].z)
+			{
+				kernelFirst = int(kern.adaptiveTiers[t].x);
+				tapCount = int(kern.adaptiveTiers[t].y);
+				kernelAdaptive = true;
+				break;
+			}
+		}
+	}
+
     vec3 colorBlurred = colorM.xyz; //Set centre pixel value
-    colorBlurred *= kernel[0].rgb;
-    for (int i = 1; i < NUM_SAMPLES; i++) //For each sample
+    colorBlurred *= kernelTap(0).rgb;
+
+	//Neighbouring pixels start on different taps and the start moves every frame, so the skipped taps are covered over time
+	int phase = 0;
+	if (TEMPORAL_PHASES > 1)
 	{
+		ivec2 pixel = ivec2(gl_FragCoord.xy);
+		phase = (int(frame.temporal.x) + pixel.x + 3 * pixel.y) % TEMPORAL_PHASES;
+	}
+	float tapWeight = float(TEMPORAL_PHASES); //Scale the taps taken up to the energy of the full kernel
+
+    for (int i = 1 + phase; i < tapCount; i += TEMPORAL_PHASES) //For each sample
+	{
+		vec4 k = kernelTap(i);
+
 		//Sample surrounding pixels
-        vec2 sampleTexCoord = fragTexCoord + kernel[i].a * offset;
-        vec3 color = texture(colourSampler, sampleTexCoord).rgb;
+        vec2 sampleTexCoord = fragTexCoord + k.a * offset;
+        vec4 tap = fetchTap(sampleTexCoord);
+        vec3 color = tap.rgb;
 		
 		//To help avoid over blurring steep edges which large colours changes,
 		//	lerp back to original colour based on diffrence in depth between the centre and sampled pixel
-        float depth = texture(normSampler, sampleTexCoord).a;
+        float depth = tap.a;
         float dd = abs(depthM - depth);
 		float s = clamp(EDGE_LERP_SCALE * dist * subsurfWidth * dd, 0.0f, 1.0f);
         color = mix(color, colorM.rgb, s);
 
-        colorBlurred += kernel[i].rgb * color; //Multiply colour by the kernel areas and accumulate the result
+        colorBlurred += tapWeight * k.rgb * color; //Multiply colour by the kernel areas and accumulate the result
     }
 
-	outColor = vec4(colorBlurred.rgb, 1);
+	if (ACCUMULATE)
+	{
+		//Find this surface last frame, blend with the history there unless it was showing something else
+		vec3 result = colorBlurred;
+		if (frame.temporal.w > 0.5f)
+		{
+			vec2 prevTexCoord = fragTexCoord + texture(motionSampler, fragTexCoord).rg;
+			//Only the offset is stored, last frame's depth is taken as if the surface had not moved (exact for the camera's own motion)
+			vec4 world = frame.invViewProj * vec4(fragTexCoord * 2.0 - 1.0, depthM, 1.0);
+			vec4 prevClip = frame.prevViewProj * vec4(world.xyz / world.w, 1.0); //w is the view distance last frame
+			if (all(greaterThanEqual(prevTexCoord, vec2(0.0))) && all(lessThanEqual(prevTexCoord, vec2(1.0))))
+			{
+				vec4 history = texture(historySampler, prevTexCoord);
+				//Compared in view space, raw depth is too compressed away from the near plane for a fixed tolerance
+				if (abs(linearDepth(history.a) - prevClip.w) < HISTORY_DEPTH_TOLERANCE * prevClip.w)
+					result = mix(history.rgb, colorBlurred, frame.temporal.z);
+			}
+		}
+		outColor = vec4(result, depthM); //Depth kept with the history for next frame's disocclusion test
+		return;
+	}
+
+	outColor = vec4(colorBlurred.rgb, colorM.a); //Flag or packed depth passed on to the vertical pass
 	
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+#define DEPTH_EPSILON 0.0001 //Stops a neighbour at exactly the same depth taking all the weight
+#define NORMAL_POWER 8.0 //How quickly the weight falls off as the normals diverge
+
+layout(location = 1) in vec2 fragTexCoord;
+
+//Reduced resolution blur result
+layout(binding = 1) uniform sampler2D blurSampler;
+//Full resolution depth, the bits of the float
+layout(binding = 2) uniform usampler2D depthSampler;
+//Full resolution colour with the subsurface flag in alpha
+layout(binding = 3) uniform sampler2D colourSampler;
+//Full resolution normals, octahedral encoded in rg
+layout(binding = 4) uniform usampler2D normSampler;
+
+layout(location = 0) out vec4 outColor;
+
+vec3 octDecode(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+//Nearest texel of an integer GBuffer target, these cannot be filtered
+uvec4 fetchGBuffer(usampler2D target, vec2 texCoord)
+{
+	ivec2 size = textureSize(target, 0);
+	return texelFetch(target, clamp(ivec2(texCoord * vec2(size)), ivec2(0), size - 1), 0);
+}
+
+void main() {
+	vec4 colorM = texture(colourSampler, fragTexCoord);
+
+	//Pixels without subsurface scattering were never blurred
+	if (colorM.a < 0.5) {
+		outColor = vec4(colorM.rgb, 1);
+		return;
+	}
+
+	vec3 normalM = octDecode(vec2(fetchGBuffer(normSampler, fragTexCoord).rg) / 1023.0);
+	float depthM = uintBitsToFloat(fetchGBuffer(depthSampler, fragTexCoord).r);
+	vec2 lowSize = vec2(textureSize(blurSampler, 0));
+
+	//The four reduced texels around this pixel
+	vec2 position = fragTexCoord * lowSize - 0.5;
+	vec2 base = floor(position);
+	vec2 f = position - base;
+
+	vec3 colorSum = vec3(0);
+	float weightSum = 0.0;
+	for (int y = 0; y < 2; y++)
+	{
+		for (int x = 0; x < 2; x++)
+		{
+			vec2 texel = clamp(base + vec2(x, y), vec2(0), lowSize - 1.0);
+
+			//The reduced passes sampled the full resolution GBuffer at the texel centre, so this is the depth and normal they blurred
+			vec2 texelCentre = (texel + 0.5) / lowSize;
+			vec3 normalS = octDecode(vec2(fetchGBuffer(normSampler, texelCentre).rg) / 1023.0);
+			float depthS = uintBitsToFloat(fetchGBuffer(depthSampler, texelCentre).r);
+
+			float bilinear = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+			float depthWeight = 1.0 / (DEPTH_EPSILON + abs(depthM - depthS));
+			float normalWeight = pow(max(dot(normalM, normalS), 0.0), NORMAL_POWER);
+			float weight = bilinear * depthWeight * normalWeight;
+
+			colorSum += texelFetch(blurSampler, ivec2(texel), 0).rgb * weight;
+			weightSum += weight;
+		}
+	}
+
+	//No neighbour lies on the same surface (thin features), keep the unblurred colour
+	outColor = vec4(weightSum > 0.0001 ? colorSum / weightSum : colorM.rgb, 1);
+}
@@ -0,0 +1,121 @@
+#include "AppSettings.h"
+
+#include <stdexcept>
+#include <string>
+
+AppSettings AppSettings::FromCommandLine(int argc, char** argv)
+{
+	AppSettings settings;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		//Options that take a value read the next argument
+		auto nextValue = [&]() -> std::string {
+			if (i + 1 >= argc) {
+				throw std::runtime_error("missing value for " + arg);
+			}
+			return argv[++i];
+		};
+
+		if (arg == "--headless")
+			settings.headless = true;
+		else if (arg == "--frames")
+			settings.benchmarkFrames = std::stoul(nextValue());
+		else if (arg == "--warmup")
+			settings.warmupFrames = std::stoul(nextValue());
+		else if (arg == "--timestep")
+			settings.fixedTimestep = std::stof(nextValue());
+		else if (arg == "--width")
+			settings.width = std::stoul(nextValue());
+		else if (arg == "--height")
+			settings.height = std::stoul(nextValue());
+		else if (arg == "--gpu-report")
+			settings.gpuReportInterval = std::stoul(nextValue());
+		else if (arg == "--gpu-csv")
+			settings.gpuCsvPath = nextValue();
+		else if (arg == "--record-each-frame")
+			settings.recordEachFrame = true;
+		else if (arg == "--record-threads")
+			settings.recordThreads = std::stoul(nextValue());
+		else if (arg == "--sss-compute")
+			settings.computeSubsurface = true;
+		else if (arg == "--sss-samples")
+			settings.subsurfaceSamples = std::stoul(nextValue());
+		else if (arg == "--sss-scale")
+		{
+			settings.subsurfaceScale = std::stoul(nextValue());
+			if (settings.subsurfaceScale != 1 && settings.subsurfaceScale != 2 && settings.subsurfaceScale != 4) {
+				throw std::runtime_error("--sss-scale must be 1, 2 or 4");
+			}
+		}
+		else if (arg == "--sss-temporal")
+		{
+			settings.subsurfaceTemporalPhases = std::stoul(nextValue());
+			if (settings.subsurfaceTemporalPhases < 1 || settings.subsurfaceTemporalPhases > 8) {
+				throw std::runtime_error("--sss-temporal must be between 1 and 8");
+			}
+		}
+		else if (arg == "--sss-bilinear")
+			settings.subsurfaceBilinear = true;
+		else if (arg == "--sss-packed-depth")
+			settings.subsurfacePackedDepth = true;
+		else if (arg == "--sss-tiles")
+			settings.subsurfaceTiles = true;
+		else if (arg == "--sss-adaptive")
+			settings.subsurfaceAdaptive = true;
+		else if (arg == "--sss-profiles-scene")
+			settings.subsurfaceProfilesScene = true;
+		else if (arg == "--sss-burley")
+			settings.burleySubsurface = true;
+		else if (arg == "--depth-prepass")
+			settings.depthPrePass = true;
+		else if (arg == "--gbuffer-subpasses")
+			settings.gbufferSubpasses = true;
+		else if (arg == "--shadow-filter")
+		{
+			std::string filter = nextValue();
+			if (filter == "none")
+				settings.shadowFilter = 0;
+			else if (filter == "grid")
+				settings.shadowFilter = 1;
+			else if (filter == "poisson")
+				settings.shadowFilter = 2;
+			else if (filter == "rotated")
+				settings.shadowFilter = 3;
+			else
+				throw std::runtime_error("--shadow-filter must be none, grid, poisson or rotated");
+		}
+		else if (arg == "--shadow-taps")
+			settings.shadowTaps = std::stoul(nextValue());
+		else
+			throw std::runtime_error("unknown argument: " + arg);
+	}
+
+	//The history is kept at full resolution
+	if (settings.subsurfaceTemporalPhases > 1 && settings.subsurfaceScale > 1) {
+		throw std::runtime_error("--sss-temporal cannot be combined with --sss-scale");
+	}
+	//The reduced passes rely on nearest sampling to downsample the GBuffer
+	if (settings.subsurfaceBilinear && settings.subsurfaceScale > 1) {
+		throw std::runtime_error("--sss-bilinear cannot be combined with --sss-scale");
+	}
+	//The reduced targets keep the swap chain format
+	if (settings.subsurfacePackedDepth && settings.subsurfaceScale > 1) {
+		throw std::runtime_error("--sss-packed-depth cannot be combined with --sss-scale");
+	}
+	//The raster blur is already limited to subsurface pixels by its stencil mask
+	if (settings.subsurfaceTiles && !settings.computeSubsurface) {
+		throw std::runtime_error("--sss-tiles needs --sss-compute");
+	}
+	//The rotated grid is square, the Poisson disk holds 16 points
+	if (settings.shadowFilter == 3 && settings.shadowTaps != 4 && settings.shadowTaps != 9 && settings.shadowTaps != 16) {
+		throw std::runtime_error("--shadow-taps must be 4, 9 or 16 with the rotated grid");
+	}
+	if (settings.shadowFilter == 2 && (settings.shadowTaps < 1 || settings.shadowTaps > 16)) {
+		throw std::runtime_error("--shadow-taps must be between 1 and 16 with the Poisson disk");
+	}
+
+	return settings;
+}
@@ -0,0 +1,158 @@
+#include "CommandRecorder.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void CommandRecorder::Create(VkDevice device, uint32_t queueFamily, uint32_t threadCount, uint32_t frameCount)
+{
+	m_Device = device;
+	m_FrameCount = frameCount;
+	m_ThreadCount = threadCount;
+	if (m_ThreadCount == 0)
+		m_ThreadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	//Transient, the buffers are recorded once and thrown away when the pool is reset
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamily;
+
+	m_Pools.resize(m_FrameCount * (m_ThreadCount + 1));
+	m_Secondaries.resize(m_Pools.size());
+	for (size_t i = 0; i < m_Pools.size(); i++) {
+		if (vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_Pools[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create recording command pool!");
+		}
+	}
+
+	//One primary per frame, from the pool no worker uses
+	m_Primaries.resize(m_FrameCount);
+	for (uint32_t frame = 0; frame < m_FrameCount; frame++) {
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = pool(frame, m_ThreadCount);
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(m_Device, &allocInfo, &m_Primaries[frame]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate command buffers!");
+		}
+	}
+
+	for (uint32_t thread = 0; thread < m_ThreadCount; thread++)
+		m_Threads.emplace_back(&CommandRecorder::workerLoop, this, thread);
+}
+
+void CommandRecorder::CleanUp()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_Start.notify_all();
+	for (size_t i = 0; i < m_Threads.size(); i++)
+		m_Threads[i].join();
+	m_Threads.clear();
+
+	//Destroying a pool frees every buffer allocated from it
+	for (size_t i = 0; i < m_Pools.size(); i++)
+		vkDestroyCommandPool(m_Device, m_Pools[i], nullptr);
+	m_Pools.clear();
+	m_Primaries.clear();
+	m_Secondaries.clear();
+}
+
+void CommandRecorder::ResetFrame(uint32_t frame)
+{
+	for (uint32_t thread = 0; thread <= m_ThreadCount; thread++) {
+		if (vkResetCommandPool(m_Device, pool(frame, thread), 0) != VK_SUCCESS) {
+			throw std::runtime_error("failed to reset recording command pool!");
+		}
+	}
+}
+
+VkCommandBuffer CommandRecorder::BeginSecondary(uint32_t frame, uint32_t thread, uint32_t index, VkRenderPass renderPass, VkFramebuffer framebuffer)
+{
+	//Allocate on first use, after that the buffer is recycled by ResetFrame
+	std::vector<VkCommandBuffer>& secondaries = m_Secondaries[frame * (m_ThreadCount + 1) + thread];
+	while (secondaries.size() <= index) {
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = pool(frame, thread);
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_Device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate secondary command buffer!");
+		}
+		secondaries.push_back(commandBuffer);
+	}
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = framebuffer;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	if (vkBeginCommandBuffer(secondaries[index], &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording secondary command buffer!");
+	}
+	return secondaries[index];
+}
+
+void CommandRecorder::Run(const std::function<void(uint32_t)>& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Job = &job;
+		m_Pending = m_ThreadCount;
+		m_Error = nullptr;
+		m_Generation++;
+	}
+	m_Start.notify_all();
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_Done.wait(lock, [this] { return m_Pending == 0; });
+	m_Job = nullptr;
+
+	//Surface worker errors on the calling thread
+	if (m_Error)
+		std::rethrow_exception(m_Error);
+}
+
+void CommandRecorder::workerLoop(uint32_t thread)
+{
+	uint64_t generation = 0;
+	for (;;)
+	{
+		const std::function<void(uint32_t)>* job;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Start.wait(lock, [&] { return m_Quit || m_Generation != generation; });
+			if (m_Quit)
+				return;
+			generation = m_Generation;
+			job = m_Job;
+		}
+
+		std::exception_ptr error;
+		try {
+			(*job)(thread);
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (error && !m_Error)
+			m_Error = error;
+		if (--m_Pending == 0)
+			m_Done.notify_one();
+	}
+}
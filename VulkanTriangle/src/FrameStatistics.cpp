@@ -0,0 +1,37 @@
+#include "FrameStatistics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+
+float FrameStatistics::percentile(const std::vector<float>& sorted, float fraction)
+{
+	//Nearest rank, clamped so p100 returns the last sample
+	size_t rank = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5f);
+	return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+void FrameStatistics::report(std::ostream & out, const std::string & label) const
+{
+	if (m_Samples.empty())
+	{
+		out << label << ": no samples" << std::endl;
+		return;
+	}
+
+	//Sort a copy so the recorded order is kept
+	std::vector<float> sorted = m_Samples;
+	std::sort(sorted.begin(), sorted.end());
+
+	float mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+
+	out << std::fixed << std::setprecision(3)
+		<< label << " (" << sorted.size() << " frames, ms)"
+		<< " min " << sorted.front()
+		<< " mean " << mean
+		<< " p50 " << percentile(sorted, 0.50f)
+		<< " p95 " << percentile(sorted, 0.95f)
+		<< " p99 " << percentile(sorted, 0.99f)
+		<< " max " << sorted.back()
+		<< std::defaultfloat << std::endl;
+}
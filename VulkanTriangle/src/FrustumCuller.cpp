@@ -0,0 +1,121 @@
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define FRUSTUM_CULLER_SSE
+#include <xmmintrin.h>
+#endif
+
+void FrustumCuller::Resize(size_t count)
+{
+	m_Count = count;
+
+	//Pad to whole groups of four, the padding is never reported
+	size_t padded = (count + 3) & ~size_t(3);
+	m_CenterX.resize(padded, 0.0f);
+	m_CenterY.resize(padded, 0.0f);
+	m_CenterZ.resize(padded, 0.0f);
+	m_ExtentX.resize(padded, 0.0f);
+	m_ExtentY.resize(padded, 0.0f);
+	m_ExtentZ.resize(padded, 0.0f);
+	m_Radius.resize(padded, 0.0f);
+}
+
+void FrustumCuller::SetBounds(size_t index, glm::vec3 center, glm::vec3 extents, float radius)
+{
+	m_CenterX[index] = center.x;
+	m_CenterY[index] = center.y;
+	m_CenterZ[index] = center.z;
+	m_ExtentX[index] = extents.x;
+	m_ExtentY[index] = extents.y;
+	m_ExtentZ[index] = extents.z;
+	m_Radius[index] = radius;
+}
+
+void FrustumCuller::ExtractPlanes(const glm::mat4& viewProj, glm::vec4 planes[6])
+{
+	//Rows of the matrix (glm is column major)
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+
+	planes[0] = row[3] + row[0]; //Left
+	planes[1] = row[3] - row[0]; //Right
+	planes[2] = row[3] + row[1]; //Bottom
+	planes[3] = row[3] - row[1]; //Top
+	planes[4] = row[2];          //Near (depth starts at 0 in Vulkan)
+	planes[5] = row[3] - row[2]; //Far
+
+	//Normalize so the distances can be compared against the radius and extents
+	for (int i = 0; i < 6; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+void FrustumCuller::Cull(const glm::mat4& viewProj, std::vector<uint8_t>& visible) const
+{
+	glm::vec4 planes[6];
+	ExtractPlanes(viewProj, planes);
+
+	visible.resize(m_Count);
+
+#ifdef FRUSTUM_CULLER_SSE
+	//Splat each plane once
+	__m128 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+	for (int p = 0; p < 6; p++)
+	{
+		nx[p] = _mm_set1_ps(planes[p].x);
+		ny[p] = _mm_set1_ps(planes[p].y);
+		nz[p] = _mm_set1_ps(planes[p].z);
+		nw[p] = _mm_set1_ps(planes[p].w);
+		ax[p] = _mm_set1_ps(std::abs(planes[p].x));
+		ay[p] = _mm_set1_ps(std::abs(planes[p].y));
+		az[p] = _mm_set1_ps(std::abs(planes[p].z));
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	for (size_t i = 0; i < m_Count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&m_CenterX[i]);
+		__m128 cy = _mm_loadu_ps(&m_CenterY[i]);
+		__m128 cz = _mm_loadu_ps(&m_CenterZ[i]);
+		__m128 ex = _mm_loadu_ps(&m_ExtentX[i]);
+		__m128 ey = _mm_loadu_ps(&m_ExtentY[i]);
+		__m128 ez = _mm_loadu_ps(&m_ExtentZ[i]);
+		__m128 radius = _mm_loadu_ps(&m_Radius[i]);
+
+		//All four start inside, each plane can only remove them
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+		for (int p = 0; p < 6; p++)
+		{
+			//Signed distance of the centre
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)), _mm_add_ps(_mm_mul_ps(nz[p], cz), nw[p]));
+			//Projected radius of the box, or the sphere if that is tighter along this normal
+			__m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+			__m128 reach = _mm_min_ps(boxRadius, radius);
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), zero));
+			if (_mm_movemask_ps(inside) == 0)
+				break;
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		size_t count = std::min<size_t>(4, m_Count - i);
+		for (size_t k = 0; k < count; k++)
+			visible[i + k] = static_cast<uint8_t>((mask >> k) & 1);
+	}
+#else
+	for (size_t i = 0; i < m_Count; i++)
+	{
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+		{
+			float distance = planes[p].x * m_CenterX[i] + planes[p].y * m_CenterY[i] + planes[p].z * m_CenterZ[i] + planes[p].w;
+			float boxRadius = std::abs(planes[p].x) * m_ExtentX[i] + std::abs(planes[p].y) * m_ExtentY[i] + std::abs(planes[p].z) * m_ExtentZ[i];
+			inside = distance + std::min(boxRadius, m_Radius[i]) >= 0.0f;
+		}
+		visible[i] = inside ? 1 : 0;
+	}
+#endif
+}
@@ -0,0 +1,57 @@
+#include "GeometryArena.h"
+
+#include "VulkanEngine.h"
+
+#include <stdexcept>
+
+MeshRange GeometryArena::Add(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	if (m_VertexBuffer != VK_NULL_HANDLE) {
+		throw std::runtime_error("meshes must be added to the geometry arena before it is uploaded!");
+	}
+
+	MeshRange mesh = {};
+	mesh.firstIndex = static_cast<uint32_t>(m_Indices.size());
+	mesh.indexCount = static_cast<uint32_t>(indices.size());
+	mesh.vertexOffset = static_cast<int32_t>(m_Vertices.size()); //Added to every index when drawing, so the indices stay mesh relative
+
+	m_Vertices.insert(m_Vertices.end(), vertices.begin(), vertices.end());
+	m_Indices.insert(m_Indices.end(), indices.begin(), indices.end());
+	return mesh;
+}
+
+void GeometryArena::Upload(VulkanEngine* engine, VkDevice device, VkQueue graphicsQueue, VkCommandPool commandPool)
+{
+	m_Device = device;
+
+	engine->createDeviceLocalBuffer(graphicsQueue, commandPool, m_Vertices.data(), sizeof(Vertex) * m_Vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m_VertexBuffer, m_VertexBufferMemory);
+	engine->createDeviceLocalBuffer(graphicsQueue, commandPool, m_Indices.data(), sizeof(uint32_t) * m_Indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_IndexBuffer, m_IndexBufferMemory);
+
+	//The GPU copy is all that is needed from here on
+	m_Vertices = std::vector<Vertex>();
+	m_Indices = std::vector<uint32_t>();
+}
+
+void GeometryArena::CleanUp()
+{
+	if (m_VertexBuffer == VK_NULL_HANDLE)
+		return;
+
+	//Clean up index buffer
+	vkDestroyBuffer(m_Device, m_IndexBuffer, nullptr);
+	vkFreeMemory(m_Device, m_IndexBufferMemory, nullptr);
+
+	//clean up vertex buffer
+	vkDestroyBuffer(m_Device, m_VertexBuffer, nullptr);
+	vkFreeMemory(m_Device, m_VertexBufferMemory, nullptr);
+
+	m_VertexBuffer = VK_NULL_HANDLE;
+	m_IndexBuffer = VK_NULL_HANDLE;
+}
+
+void GeometryArena::CmdBind(VkCommandBuffer commandBuffer) const
+{
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_VertexBuffer, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
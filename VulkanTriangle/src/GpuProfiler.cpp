@@ -0,0 +1,286 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+void GpuProfiler::Create(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t timestampValidBits, bool countFragments, uint32_t reportInterval, const std::string& csvPath)
+{
+	m_Device = device;
+	m_ReportInterval = reportInterval;
+	m_CountFragments = countFragments;
+
+	//Timestamps are optional, without them the profiler silently does nothing
+	m_Supported = timestampValidBits > 0;
+	if (!m_Supported)
+	{
+		std::cout << "GPU timestamps not supported, pass timings disabled" << std::endl;
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_TimestampPeriod = properties.limits.timestampPeriod;
+	m_TimestampMask = timestampValidBits >= 64 ? ~0ull : ((1ull << timestampValidBits) - 1);
+
+	if (!csvPath.empty())
+	{
+		m_Csv.open(csvPath);
+		if (!m_Csv) {
+			throw std::runtime_error("failed to open " + csvPath);
+		}
+
+		m_Csv << "frame";
+		for (uint32_t p = 0; p < GPU_PASS_COUNT; p++)
+			m_Csv << "," << GetPassName(static_cast<GpuPass>(p));
+		if (m_CountFragments)
+			m_Csv << ",GBuffer fragments";
+		m_Csv << std::endl;
+	}
+}
+
+void GpuProfiler::CreateQueries(uint32_t setCount)
+{
+	if (!m_Supported)
+		return;
+
+	m_SetCount = setCount;
+	m_Pending.assign(setCount, false);
+
+	VkQueryPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = setCount * GPU_PASS_COUNT * 2;
+
+	if (vkCreateQueryPool(m_Device, &poolInfo, nullptr, &m_QueryPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create timestamp query pool!");
+	}
+
+	if (!m_CountFragments)
+		return;
+
+	poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	poolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+	poolInfo.queryCount = setCount;
+
+	if (vkCreateQueryPool(m_Device, &poolInfo, nullptr, &m_StatisticsPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline statistics query pool!");
+	}
+}
+
+void GpuProfiler::DestroyQueries()
+{
+	if (m_QueryPool == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyQueryPool(m_Device, m_QueryPool, nullptr);
+	m_QueryPool = VK_NULL_HANDLE;
+	if (m_StatisticsPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(m_Device, m_StatisticsPool, nullptr);
+	m_StatisticsPool = VK_NULL_HANDLE;
+	m_Pending.clear();
+	m_SetCount = 0;
+}
+
+void GpuProfiler::CleanUp()
+{
+	DestroyQueries();
+	if (m_Csv.is_open())
+		m_Csv.close();
+}
+
+void GpuProfiler::CmdReset(VkCommandBuffer commandBuffer, uint32_t set)
+{
+	if (!Enabled())
+		return;
+
+	vkCmdResetQueryPool(commandBuffer, m_QueryPool, queryIndex(set, GPU_PASS_CULL, false), GPU_PASS_COUNT * 2);
+	if (m_StatisticsPool != VK_NULL_HANDLE)
+		vkCmdResetQueryPool(commandBuffer, m_StatisticsPool, set, 1);
+}
+
+void GpuProfiler::CmdBegin(VkCommandBuffer commandBuffer, uint32_t set, GpuPass pass)
+{
+	if (!Enabled())
+		return;
+
+	//Top of pipe, written as soon as the previous commands start so the pass is not charged for waiting on the ones before
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_QueryPool, queryIndex(set, pass, false));
+}
+
+void GpuProfiler::CmdEnd(VkCommandBuffer commandBuffer, uint32_t set, GpuPass pass)
+{
+	if (!Enabled())
+		return;
+
+	//Bottom of pipe, written once every command of the pass has finished
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_QueryPool, queryIndex(set, pass, true));
+}
+
+void GpuProfiler::CmdBeginFragments(VkCommandBuffer commandBuffer, uint32_t set)
+{
+	if (!Enabled() || m_StatisticsPool == VK_NULL_HANDLE)
+		return;
+
+	vkCmdBeginQuery(commandBuffer, m_StatisticsPool, set, 0);
+}
+
+void GpuProfiler::CmdEndFragments(VkCommandBuffer commandBuffer, uint32_t set)
+{
+	if (!Enabled() || m_StatisticsPool == VK_NULL_HANDLE)
+		return;
+
+	vkCmdEndQuery(commandBuffer, m_StatisticsPool, set);
+}
+
+void GpuProfiler::Submitted(uint32_t set)
+{
+	if (!Enabled())
+		return;
+
+	m_Pending[set] = true;
+}
+
+bool GpuProfiler::Collect(uint32_t set)
+{
+	if (!Enabled() || set >= m_SetCount || !m_Pending[set])
+		return false;
+
+	//No wait flag, if the GPU has not finished the set yet try again next time rather than stall
+	std::array<uint64_t, GPU_PASS_COUNT * 2> timestamps;
+	VkResult result = vkGetQueryPoolResults(m_Device, m_QueryPool, queryIndex(set, GPU_PASS_CULL, false), GPU_PASS_COUNT * 2,
+		sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result == VK_NOT_READY)
+		return false;
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to read timestamp queries!");
+	}
+	uint64_t fragments = 0;
+	if (m_StatisticsPool != VK_NULL_HANDLE)
+	{
+		result = vkGetQueryPoolResults(m_Device, m_StatisticsPool, set, 1, sizeof(fragments), &fragments, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result == VK_NOT_READY)
+			return false;
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to read pipeline statistics queries!");
+		}
+	}
+	m_Pending[set] = false;
+
+	if (m_Csv.is_open())
+		m_Csv << m_FramesCollected;
+
+	for (uint32_t p = 0; p < GPU_PASS_COUNT; p++)
+	{
+		//Mask the difference so a counter wrapping between the two stamps still gives the right value
+		uint64_t ticks = (timestamps[p * 2 + 1] - timestamps[p * 2]) & m_TimestampMask;
+		float ms = static_cast<float>(ticks * static_cast<double>(m_TimestampPeriod) / 1000000.0);
+
+		m_History[p][m_HistoryHead] = ms;
+		m_Statistics[p].record(ms);
+
+		if (m_Csv.is_open())
+			m_Csv << "," << ms;
+	}
+	if (m_StatisticsPool != VK_NULL_HANDLE)
+	{
+		m_FragmentHistory[m_HistoryHead] = fragments;
+		m_FragmentTotal += fragments;
+		m_FragmentFrames++;
+		if (m_Csv.is_open())
+			m_Csv << "," << fragments;
+	}
+	if (m_Csv.is_open())
+		m_Csv << "\n";
+
+	m_HistoryHead = (m_HistoryHead + 1) % ROLLING_FRAMES;
+	m_HistoryCount = std::min(m_HistoryCount + 1, ROLLING_FRAMES);
+	m_FramesCollected++;
+
+	if (m_ReportInterval > 0 && m_FramesCollected % m_ReportInterval == 0)
+		Report(std::cout);
+
+	return true;
+}
+
+float GpuProfiler::GetPassMs(GpuPass pass) const
+{
+	if (m_HistoryCount == 0)
+		return 0.0f;
+
+	float total = 0.0f;
+	for (uint32_t i = 0; i < m_HistoryCount; i++)
+		total += m_History[pass][i];
+	return total / m_HistoryCount;
+}
+
+uint64_t GpuProfiler::GetFragmentCount() const
+{
+	if (m_HistoryCount == 0)
+		return 0;
+
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < m_HistoryCount; i++)
+		total += m_FragmentHistory[i];
+	return total / m_HistoryCount;
+}
+
+const char* GpuProfiler::GetPassName(GpuPass pass)
+{
+	switch (pass)
+	{
+	case GPU_PASS_CULL:
+		return "Cull";
+	case GPU_PASS_SHADOW:
+		return "Shadow";
+	case GPU_PASS_GBUFFER:
+		return "GBuffer";
+	case GPU_PASS_LIGHTING:
+		return "Lighting";
+	case GPU_PASS_SSS_HORIZONTAL:
+		return "SSS horizontal";
+	case GPU_PASS_SSS_VERTICAL:
+		return "SSS vertical";
+	default:
+		return "Unknown";
+	}
+}
+
+void GpuProfiler::Report(std::ostream& out) const
+{
+	if (!Enabled())
+		return;
+
+	float total = 0.0f;
+	out << std::fixed << std::setprecision(3) << "GPU (ms, last " << m_HistoryCount << " frames)";
+	for (uint32_t p = 0; p < GPU_PASS_COUNT; p++)
+	{
+		float ms = GetPassMs(static_cast<GpuPass>(p));
+		total += ms;
+		out << " | " << GetPassName(static_cast<GpuPass>(p)) << " " << ms;
+	}
+	out << " | Total " << total << std::defaultfloat;
+	if (m_StatisticsPool != VK_NULL_HANDLE)
+		out << " | GBuffer fragments " << GetFragmentCount();
+	out << std::endl;
+}
+
+void GpuProfiler::ReportSummary(std::ostream& out) const
+{
+	if (!Enabled())
+		return;
+
+	for (uint32_t p = 0; p < GPU_PASS_COUNT; p++)
+		m_Statistics[p].report(out, std::string("GPU ") + GetPassName(static_cast<GpuPass>(p)));
+	if (m_FragmentFrames > 0)
+		out << "GPU GBuffer fragment shader invocations (" << m_FragmentFrames << " frames) mean " << m_FragmentTotal / m_FragmentFrames << std::endl;
+}
+
+void GpuProfiler::ClearStatistics()
+{
+	for (uint32_t p = 0; p < GPU_PASS_COUNT; p++)
+		m_Statistics[p].clear();
+	m_FragmentTotal = 0;
+	m_FragmentFrames = 0;
+}
@@ -0,0 +1,37 @@
+#include "Material.h"
+
+#include "VulkanEngine.h"
+
+Material::Material(VulkanEngine* engine, VkDevice& device, VkQueue graphicsQueue, VkCommandPool commandPool, const char* texturePath, const char* nTexturePath, const char* sTexturePath) : m_Device(device)
+{
+	engine->createTextureImage(graphicsQueue, commandPool, textureImage, textureImageMemory, texturePath);
+	textureImageView = engine->createTextureImageView(textureImage);
+	engine->createTextureSampler(textureSampler);
+
+	engine->createTextureImage(graphicsQueue, commandPool, ntextureImage, ntextureImageMemory, nTexturePath);
+	ntextureImageView = engine->createTextureImageView(ntextureImage);
+	engine->createTextureSampler(ntextureSampler);
+
+	engine->createTextureImage(graphicsQueue, commandPool, stextureImage, stextureImageMemory, sTexturePath);
+	stextureImageView = engine->createTextureImageView(stextureImage);
+	engine->createTextureSampler(stextureSampler);
+}
+
+Material::~Material()
+{
+	//Cleanup Texture
+	vkDestroyImage(m_Device, textureImage, nullptr);
+	vkDestroyImageView(m_Device, textureImageView, nullptr);
+	vkDestroySampler(m_Device, textureSampler, nullptr);
+	vkFreeMemory(m_Device, textureImageMemory, nullptr);
+
+	vkDestroyImage(m_Device, ntextureImage, nullptr);
+	vkDestroyImageView(m_Device, ntextureImageView, nullptr);
+	vkDestroySampler(m_Device, ntextureSampler, nullptr);
+	vkFreeMemory(m_Device, ntextureImageMemory, nullptr);
+
+	vkDestroyImage(m_Device, stextureImage, nullptr);
+	vkDestroyImageView(m_Device, stextureImageView, nullptr);
+	vkDestroySampler(m_Device, stextureSampler, nullptr);
+	vkFreeMemory(m_Device, stextureImageMemory, nullptr);
+}
@@ -0,0 +1,820 @@
+#include "SubsurfacePass.h"
+
+#include "VulkanEngine.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+//Must match TILE in sss_blur.comp, each workgroup blurs this many pixels of one row or column
+static const uint32_t BLUR_TILE = 128;
+//Must match TILE_SIZE in sss_classify.comp and sss_tile_blur.comp, the classification pass marks tiles this many pixels square
+static const uint32_t CLASSIFY_TILE = 16;
+//Tap counts of the smaller kernels picked by the adaptive blur, smallest first
+static const int ADAPTIVE_TIER_TAPS[ADAPTIVE_TIERS] = { 7, 11, 17 };
+//Average distance in pixels between the taps of an adaptive tier at the widest kernel it is used for
+static const float ADAPTIVE_TAP_SPACING = 1.0f;
+//Burley scattering distance per unit of profile falloff, in kernel units. Most of the diffusion then falls inside BURLEY_RANGE
+static const float BURLEY_DISTANCE = 0.25f;
+//Furthest a Burley disk tap reaches in kernel units, the same range as the separable kernel
+static const float BURLEY_RANGE = 2.0f;
+
+//Fraction of Burley's normalized diffusion with scattering distance d that lands within radius r of the entry point
+static float BurleyCdf(float r, float d)
+{
+	return 1.0f - 0.25f * std::exp(-r / d) - 0.75f * std::exp(-r / (3.0f * d));
+}
+
+//Density of BurleyCdf along the radius, the diffusion profile already multiplied by the circumference
+static float BurleyPdf(float r, float d)
+{
+	return (std::exp(-r / d) + std::exp(-r / (3.0f * d))) / (4.0f * d);
+}
+
+//Radius at which BurleyCdf reaches u, solved with Newton's method as the CDF has no closed inverse
+static float BurleyRadius(float u, float d)
+{
+	float x = -3.0f * std::log(1.0f - u); //The wider lobe alone, a close first guess
+	for (int i = 0; i < 8; i++)
+	{
+		float f = 1.0f - 0.25f * std::exp(-x) - 0.75f * std::exp(-x / 3.0f) - u;
+		float slope = 0.25f * (std::exp(-x) + std::exp(-x / 3.0f));
+		x -= f / slope;
+	}
+	return x * d;
+}
+
+void SubsurfacePass::SetSampleCount(uint32_t count)
+{
+	//The kernel needs a centre tap and the same number either side of it
+	if (count < 3 || count > MAX_SAMPLES || count % 2 == 0) {
+		throw std::runtime_error("subsurface sample count must be odd and between 3 and " + std::to_string(MAX_SAMPLES) + "!");
+	}
+
+	sampleCount = count;
+	m_MergeFallback = false;
+	computeKernel();
+
+	//Decided once per tap count, so the count the blur pipelines are specialized with still holds when a profile changes
+	for (uint32_t profile = 0; profile < MAX_PROFILES; profile++)
+	{
+		float error = MergedKernelError(profile);
+		if (error > MERGE_TOLERANCE)
+		{
+			if (mergeTaps)
+				std::cout << "Merged subsurface kernel of profile " << profile << " is " << error << " off the original, blurring with all " << sampleCount << " taps" << std::endl;
+			m_MergeFallback = true;
+			computeKernel();
+			break;
+		}
+	}
+}
+
+void SubsurfacePass::SetProfile(uint32_t index, const SubsurfaceProfile& profile)
+{
+	if (index >= MAX_PROFILES) {
+		throw std::runtime_error("subsurface profile index must be below " + std::to_string(MAX_PROFILES) + "!");
+	}
+
+	//Unchanged profiles keep their kernels and nothing is re-uploaded
+	if (profiles[index].strength == profile.strength && profiles[index].falloff == profile.falloff)
+		return;
+
+	profiles[index] = profile;
+	BuildKernel(&kernel[index * MAX_SAMPLES], static_cast<int>(sampleCount), profile);
+	BuildMergedKernel(); //Same taps paired as before, the blur's tap count does not change
+	if (mergeTaps && !m_MergeFallback)
+	{
+		float error = MergedKernelError(index);
+		if (error > MERGE_TOLERANCE)
+			std::cout << "Merged subsurface kernel of profile " << index << " is " << error << " off the original, kept at " << mergedCount << " taps" << std::endl;
+	}
+	BuildAdaptiveKernels(index);
+	BuildBurleyKernel(index);
+	kernelVersion++;
+}
+
+void SubsurfacePass::BuildMergedKernel()
+{
+	PairMergedTaps();
+
+	//Blur with every tap rather than with a kernel that visibly differs, for all profiles as they share the tap count
+	if (m_MergeFallback)
+	{
+		std::copy(kernel, kernel + MAX_PROFILES * MAX_SAMPLES, mergedKernel);
+		mergedCount = sampleCount;
+	}
+}
+
+void SubsurfacePass::PairMergedTaps()
+{
+	const int half = static_cast<int>(sampleCount) / 2;
+	int count = 0;
+
+	//The offsets only depend on sampleCount, so every profile pairs the same taps and ends up with the same count
+	for (uint32_t profile = 0; profile < MAX_PROFILES; profile++)
+	{
+		const glm::vec4* source = &kernel[profile * MAX_SAMPLES];
+		glm::vec4* merged = &mergedKernel[profile * MAX_SAMPLES];
+		count = 0;
+		merged[count++] = source[0];
+
+		//kernel holds the centre, then the negative side from the furthest tap in, then the positive side from the nearest tap out
+		for (int side = 0; side < 2; side++)
+		{
+			for (int n = 0; n < half;)
+			{
+				int a = side == 0 ? half - n : half + 1 + n;
+				int b = side == 0 ? a - 1 : a + 1;
+				bool pair = n + 1 < half && std::abs(source[a].w - source[b].w) <= MAX_MERGE_GAP;
+				if (!pair)
+				{
+					merged[count++] = source[a];
+					n++;
+					continue;
+				}
+
+				//Channels share the fetch, so the position is weighted by their total
+				float weightA = source[a].x + source[a].y + source[a].z;
+				float weightB = source[b].x + source[b].y + source[b].z;
+				float offset = weightA + weightB > 0.0f ? (weightA * source[a].w + weightB * source[b].w) / (weightA + weightB) : 0.5f * (source[a].w + source[b].w);
+				merged[count++] = glm::vec4(glm::vec3(source[a]) + glm::vec3(source[b]), offset);
+				n += 2;
+			}
+		}
+
+		for (int i = count; i < MAX_SAMPLES; i++)
+			merged[i] = glm::vec4(0);
+	}
+	mergedCount = static_cast<uint32_t>(count);
+}
+
+float SubsurfacePass::MergedKernelError(uint32_t profile) const
+{
+	//Value of the test row at x, linearly filtered between texels like the blur's sampler
+	auto row = [](float x, float period) {
+		float texel = std::floor(x);
+		float f = x - texel;
+		float a = 0.5f + 0.5f * std::sin(6.2831853f * texel / period);
+		float b = 0.5f + 0.5f * std::sin(6.2831853f * (texel + 1.0f) / period);
+		return a + (b - a) * f;
+	};
+
+	static const float widths[] = { 1.0f, 2.0f, 4.0f, 8.0f, 16.0f }; //Texels per kernel unit
+	static const float periods[] = { 16.0f, 32.0f };
+
+	const glm::vec4* source = &kernel[profile * MAX_SAMPLES];
+	const glm::vec4* merged = &mergedKernel[profile * MAX_SAMPLES];
+
+	float error = 0.0f;
+	for (float width : widths)
+	{
+		for (float period : periods)
+		{
+			for (int p = 0; p < 16; p++)
+			{
+				float centre = 0.5f + 0.37f * p; //Pixel centres at different phases of the texel grid
+				glm::vec3 original = glm::vec3(0);
+				glm::vec3 blurred = glm::vec3(0);
+				for (uint32_t i = 0; i < sampleCount; i++)
+					original += glm::vec3(source[i]) * row(centre + source[i].w * width, period);
+				for (uint32_t i = 0; i < mergedCount; i++)
+					blurred += glm::vec3(merged[i]) * row(centre + merged[i].w * width, period);
+
+				glm::vec3 difference = glm::abs(original - blurred);
+				error = std::max(error, std::max(difference.x, std::max(difference.y, difference.z)));
+			}
+		}
+	}
+	return error;
+}
+
+void SubsurfacePass::BuildAdaptiveKernels(uint32_t profile)
+{
+	glm::vec4* target = &adaptiveKernel[profile * ADAPTIVE_TAPS];
+	int first = 0;
+	for (int t = 0; t < ADAPTIVE_TIERS; t++)
+	{
+		int taps = ADAPTIVE_TIER_TAPS[t];
+		adaptiveTiers[t] = glm::vec4(first, 0, 0, 0);
+
+		//A tier is only worth picking if it is smaller than the main kernel
+		if (taps >= static_cast<int>(sampleCount))
+		{
+			for (int i = 0; i < taps; i++)
+				target[first + i] = glm::vec4(0);
+		}
+		else
+		{
+			BuildKernel(&target[first], taps, profiles[profile]);
+			adaptiveTiers[t].y = static_cast<float>(taps);
+			adaptiveTiers[t].z = (taps / 2) * ADAPTIVE_TAP_SPACING; //Taps either side of the centre
+		}
+		first += taps;
+	}
+}
+
+void SubsurfacePass::BuildBurleyKernel(uint32_t profile)
+{
+	glm::vec4* target = &burleyKernel[profile * BURLEY_SAMPLES];
+	//Same adjustments as BuildKernel makes to the profile
+	glm::vec3 distance = profiles[profile].falloff * 0.9f * BURLEY_DISTANCE;
+	glm::vec3 strength = profiles[profile].strength * 0.85f;
+
+	//Taps are spread by the widest channel, the narrower ones get more weight near the centre
+	float widest = std::max(distance.x, std::max(distance.y, distance.z));
+	float covered = BurleyCdf(BURLEY_RANGE, widest);
+
+	glm::vec3 sum = glm::vec3(0);
+	for (int i = 1; i < BURLEY_SAMPLES; i++)
+	{
+		//Equal slices of the diffusion inside the range, a tap at the middle of each
+		float u = covered * (i - 0.5f) / (BURLEY_SAMPLES - 1);
+		float r = BurleyRadius(u, widest);
+		float pdf = BurleyPdf(r, widest);
+
+		glm::vec3 weight;
+		for (int c = 0; c < 3; c++)
+			weight[c] = BurleyPdf(r, distance[c]) / pdf;
+		target[i] = glm::vec4(weight, r);
+		sum += weight;
+	}
+
+	//Same normalisation and strength as the separable kernel
+	target[0] = glm::vec4(glm::vec3(1.0f) - strength, 0.0f);
+	for (int i = 1; i < BURLEY_SAMPLES; i++)
+		target[i] = glm::vec4(glm::vec3(target[i]) / sum * strength, target[i].w);
+}
+
+const VkSpecializationInfo* SubsurfacePass::BlurSpecialization(bool accumulate)
+{
+	m_BlurEntries[0] = { 0, offsetof(BlurConstants, sampleCount), sizeof(uint32_t) };
+	m_BlurEntries[1] = { 1, offsetof(BlurConstants, temporalPhases), sizeof(uint32_t) };
+	m_BlurEntries[2] = { 2, offsetof(BlurConstants, accumulate), sizeof(VkBool32) };
+	m_BlurEntries[3] = { 3, offsetof(BlurConstants, packedDepth), sizeof(VkBool32) };
+	m_BlurEntries[4] = { 4, offsetof(BlurConstants, adaptive), sizeof(VkBool32) };
+
+	int i = accumulate ? 1 : 0;
+	m_BlurConstants[i].sampleCount = BlurTapCount();
+	m_BlurConstants[i].temporalPhases = temporalPhases;
+	m_BlurConstants[i].accumulate = accumulate ? VK_TRUE : VK_FALSE;
+	m_BlurConstants[i].packedDepth = packedDepth ? VK_TRUE : VK_FALSE;
+	m_BlurConstants[i].adaptive = adaptive ? VK_TRUE : VK_FALSE;
+
+	//Shaders without a constant ignore its entry
+	m_BlurInfo[i].mapEntryCount = 5;
+	m_BlurInfo[i].pMapEntries = m_BlurEntries;
+	m_BlurInfo[i].dataSize = sizeof(BlurConstants);
+	m_BlurInfo[i].pData = &m_BlurConstants[i];
+	return &m_BlurInfo[i];
+}
+
+void SubsurfacePass::CreateComputeTargets(VulkanEngine* engine, VkExtent2D extent)
+{
+	m_ComputeExtent = extent;
+
+	//Half floats, the GBuffer colour may be sRGB and storage images cannot be
+	for (int i = 0; i < 2; i++)
+	{
+		engine->createImage(extent.width, extent.height, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, blurImages[i], blurImageMemory[i], VK_SAMPLE_COUNT_1_BIT);
+		blurImageViews[i] = engine->createImageView(blurImages[i], VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+
+	//Dispatch arguments then room for every tile of the screen
+	if (tiled)
+	{
+		VkDeviceSize tileCount = ((extent.width + CLASSIFY_TILE - 1) / CLASSIFY_TILE) * ((extent.height + CLASSIFY_TILE - 1) / CLASSIFY_TILE);
+		engine->createBuffer(sizeof(glm::uvec4) + tileCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tileBuffer, tileBufferMemory);
+	}
+}
+
+void SubsurfacePass::CreateComputePipeline(VkDevice device, VkShaderModule shaderModule, VkDescriptorSetLayout frameSetLayout)
+{
+	//Colour and depth are sampled, the result is written as a storage image. The tiled blur also reads the GBuffer colour and the tile list, both read the material IDs at binding 5
+	std::array<VkDescriptorSetLayoutBinding, 6> bindings = {};
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = i == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : i == 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &computeSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create subsurface compute descriptor set layout!");
+	}
+
+	//Blur direction in pixels
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(glm::ivec2);
+
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { computeSetLayout, frameSetLayout };
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create subsurface compute pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.stage.pSpecializationInfo = BlurSpecialization();
+	pipelineInfo.layout = computePipelineLayout;
+
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create subsurface compute pipeline!");
+	}
+}
+
+void SubsurfacePass::CreateTilePipelines(VkDevice device, VkShaderModule classifyModule, VkShaderModule blurModule)
+{
+	//GBuffer colour in, tile list out
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &classifySetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create subsurface classification descriptor set layout!");
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &classifySetLayout;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &classifyPipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create subsurface classification pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = classifyModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = classifyPipelineLayout;
+
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &classifyPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create subsurface classification pipeline!");
+	}
+
+	//Same layout and sets as the full screen blur
+	pipelineInfo.stage.module = blurModule;
+	pipelineInfo.stage.pSpecializationInfo = BlurSpecialization();
+	pipelineInfo.layout = computePipelineLayout;
+
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &tileBlurPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create subsurface tiled blur pipeline!");
+	}
+}
+
+void SubsurfacePass::UpdateComputeSets(VkDevice device, VkImageView colourView, VkImageView depthView, VkImageView normalView, VkSampler sampler, VkBuffer uniformBuffer, VkDeviceSize uniformRange)
+{
+	//Horizontal reads the GBuffer colour, vertical reads the horizontal result
+	VkDescriptorImageInfo colourInfo[2] = {};
+	colourInfo[0] = { sampler, colourView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	colourInfo[1] = { sampler, blurImageViews[0], VK_IMAGE_LAYOUT_GENERAL };
+	VkDescriptorImageInfo depthInfo = { sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo normalInfo = { sampler, normalView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo targetInfo[2] = {};
+	targetInfo[0] = { VK_NULL_HANDLE, blurImageViews[0], VK_IMAGE_LAYOUT_GENERAL };
+	targetInfo[1] = { VK_NULL_HANDLE, blurImageViews[1], VK_IMAGE_LAYOUT_GENERAL };
+
+	//Bindings 0 to 2, then the material IDs at binding 5
+	std::array<VkWriteDescriptorSet, 11> descriptorWrites = {};
+	for (int i = 0; i < 2; i++)
+	{
+		for (int b = 0; b < 4; b++)
+		{
+			VkWriteDescriptorSet& write = descriptorWrites[i * 4 + b];
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = computeSets[i];
+			write.dstBinding = b < 3 ? b : 5;
+			write.dstArrayElement = 0;
+			write.descriptorCount = 1;
+			write.descriptorType = b == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		}
+		descriptorWrites[i * 4 + 0].pImageInfo = &colourInfo[i];
+		descriptorWrites[i * 4 + 1].pImageInfo = &depthInfo;
+		descriptorWrites[i * 4 + 2].pImageInfo = &targetInfo[i];
+		descriptorWrites[i * 4 + 3].pImageInfo = &normalInfo;
+	}
+
+	//Composite set, laid out like the raster passes' sets so it shares their pipeline layout
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = uniformBuffer;
+	bufferInfo.offset = 0; //Start of the block is given by the dynamic offset
+	bufferInfo.range = uniformRange;
+	VkDescriptorImageInfo resultInfo = { sampler, blurImageViews[1], VK_IMAGE_LAYOUT_GENERAL };
+
+	for (int b = 0; b < 3; b++)
+	{
+		VkWriteDescriptorSet& write = descriptorWrites[8 + b];
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = compositeSet;
+		write.dstBinding = b;
+		write.dstArrayElement = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = b == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	}
+	descriptorWrites[8].pBufferInfo = &bufferInfo;
+	descriptorWrites[9].pImageInfo = &resultInfo;
+	descriptorWrites[10].pImageInfo = &depthInfo;
+
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+	if (!tiled)
+		return;
+
+	//The tiled blur reads pixels without the subsurface flag from the GBuffer colour, as does the composite outside the tiles
+	VkDescriptorImageInfo gbufferInfo = { sampler, colourView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorBufferInfo tileInfo = { tileBuffer, 0, VK_WHOLE_SIZE };
+
+	std::array<VkWriteDescriptorSet, 7> tileWrites = {};
+	for (int i = 0; i < 7; i++)
+	{
+		VkWriteDescriptorSet& write = tileWrites[i];
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstArrayElement = 0;
+		write.descriptorCount = 1;
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		tileWrites[i * 2].dstSet = computeSets[i];
+		tileWrites[i * 2].dstBinding = 3;
+		tileWrites[i * 2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		tileWrites[i * 2].pImageInfo = &gbufferInfo;
+		tileWrites[i * 2 + 1].dstSet = computeSets[i];
+		tileWrites[i * 2 + 1].dstBinding = 4;
+		tileWrites[i * 2 + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		tileWrites[i * 2 + 1].pBufferInfo = &tileInfo;
+	}
+	tileWrites[4].dstSet = classifySet;
+	tileWrites[4].dstBinding = 0;
+	tileWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	tileWrites[4].pImageInfo = &gbufferInfo;
+	tileWrites[5].dstSet = classifySet;
+	tileWrites[5].dstBinding = 1;
+	tileWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	tileWrites[5].pBufferInfo = &tileInfo;
+	tileWrites[6].dstSet = compositeSet;
+	tileWrites[6].dstBinding = 3;
+	tileWrites[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	tileWrites[6].pImageInfo = &gbufferInfo;
+
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(tileWrites.size()), tileWrites.data(), 0, nullptr);
+}
+
+void SubsurfacePass::CreateScaledTargets(VulkanEngine* engine, VkDevice device, VkExtent2D extent, VkFormat colourFormat, VkFormat stencilFormat)
+{
+	//Rounded up so the reduced targets cover every full resolution pixel
+	scaledExtent.width = (extent.width + resolutionScale - 1) / resolutionScale;
+	scaledExtent.height = (extent.height + resolutionScale - 1) / resolutionScale;
+
+	engine->createImage(scaledExtent.width, scaledExtent.height, stencilFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, scaledStencilImage, scaledStencilImageMemory, VK_SAMPLE_COUNT_1_BIT);
+	scaledStencilImageView = engine->createImageView(scaledStencilImage, stencilFormat, VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
+
+	for (int i = 0; i < 2; i++)
+	{
+		engine->createImage(scaledExtent.width, scaledExtent.height, colourFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, scaledImages[i], scaledImageMemory[i], VK_SAMPLE_COUNT_1_BIT);
+		scaledImageViews[i] = engine->createImageView(scaledImages[i], colourFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+
+		std::array<VkImageView, 2> attachments = { scaledImageViews[i], scaledStencilImageView };
+		VkFramebufferCreateInfo framebufferInfo = {};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = SSRenderPass;
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebufferInfo.pAttachments = attachments.data();
+		framebufferInfo.width = scaledExtent.width;
+		framebufferInfo.height = scaledExtent.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &scaledFrameBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create reduced resolution subsurface framebuffer!");
+		}
+	}
+}
+
+void SubsurfacePass::UpdateScaledSets(VkDevice device, VkImageView colourView, VkImageView depthView, VkImageView normalView, VkSampler sampler, VkBuffer uniformBuffer, VkDeviceSize uniformRange)
+{
+	if (resolutionScale == 1)
+		return;
+
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = uniformBuffer;
+	bufferInfo.offset = 0; //Start of the block is given by the dynamic offset
+	bufferInfo.range = uniformRange;
+	VkDescriptorImageInfo horizontalInfo = { sampler, scaledImageViews[0], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo verticalInfo = { sampler, scaledImageViews[1], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo depthInfo = { sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo colourInfo = { sampler, colourView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo normalInfo = { sampler, normalView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+	//Vertical set uses bindings 0 to 2 like finalSSet, the upsample also reads the full resolution colour at binding 3
+	std::array<VkWriteDescriptorSet, 9> descriptorWrites = {};
+	for (int i = 0; i < 7; i++)
+	{
+		int b = i < 3 ? i : i - 3;
+		VkWriteDescriptorSet& write = descriptorWrites[i];
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = i < 3 ? scaledVerticalSet : upsampleSet;
+		write.dstBinding = b;
+		write.dstArrayElement = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = b == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	}
+	descriptorWrites[0].pBufferInfo = &bufferInfo;
+	descriptorWrites[1].pImageInfo = &horizontalInfo;
+	descriptorWrites[2].pImageInfo = &depthInfo;
+	descriptorWrites[3].pBufferInfo = &bufferInfo;
+	descriptorWrites[4].pImageInfo = &verticalInfo;
+	descriptorWrites[5].pImageInfo = &depthInfo;
+	descriptorWrites[6].pImageInfo = &colourInfo;
+
+	//Both read the normals at binding 4 like finalSSet, the vertical set for the material IDs and the upsample to weight its taps
+	descriptorWrites[7] = descriptorWrites[2];
+	descriptorWrites[7].dstBinding = 4;
+	descriptorWrites[7].pImageInfo = &normalInfo;
+	descriptorWrites[8] = descriptorWrites[7];
+	descriptorWrites[8].dstSet = upsampleSet;
+
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void SubsurfacePass::CreateHistoryTargets(VulkanEngine* engine, VkDevice device, VkQueue graphicsQueue, VkCommandPool commandPool, VkExtent2D extent, uint32_t count, VkImageView stencilView, VkFormat stencilFormat)
+{
+	//Every pixel is written, by the blur or the copy, so the old contents are not loaded
+	VkAttachmentDescription colourAttachment = {};
+	colourAttachment.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	colourAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colourAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colourAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colourAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colourAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colourAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colourAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	//Mask written by the horizontal pass
+	VkAttachmentDescription stencilAttachment = {};
+	stencilAttachment.format = stencilFormat;
+	stencilAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	stencilAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	stencilAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	stencilAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	stencilAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	stencilAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	stencilAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference colourReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	VkAttachmentReference stencilReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colourReference;
+	subpass.pDepthStencilAttachment = &stencilReference;
+
+	//The image was last read as history by the frame before, and is read by the composite and the next frame after
+	std::array<VkSubpassDependency, 2> dependencies = {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[1].dependencyFlags = 0; //The next frame reads it reprojected, not just at the same pixel
+
+	std::array<VkAttachmentDescription, 2> attachments = { colourAttachment, stencilAttachment };
+	VkRenderPassCreateInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassInfo.pAttachments = attachments.data();
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
+
+	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &historyRenderPass) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create subsurface history render pass!");
+	}
+
+	historyImages.resize(count);
+	historyImageMemory.resize(count);
+	historyImageViews.resize(count);
+	historyFrameBuffers.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		engine->createImage(extent.width, extent.height, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, historyImages[i], historyImageMemory[i], VK_SAMPLE_COUNT_1_BIT);
+		historyImageViews[i] = engine->createImageView(historyImages[i], VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
+		//The first frame samples the previous image before anything has written it
+		engine->transitionImageLayout(graphicsQueue, commandPool, historyImages[i], VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		std::array<VkImageView, 2> views = { historyImageViews[i], stencilView };
+		VkFramebufferCreateInfo framebufferInfo = {};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = historyRenderPass;
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+		framebufferInfo.pAttachments = views.data();
+		framebufferInfo.width = extent.width;
+		framebufferInfo.height = extent.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &historyFrameBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create subsurface history framebuffer!");
+		}
+	}
+
+	//Nothing has been accumulated yet
+	historyAge = 0;
+}
+
+void SubsurfacePass::UpdateHistorySets(VkDevice device, VkImageView horizontalView, VkImageView depthView, VkImageView normalView, VkImageView motionView, VkSampler sampler, VkBuffer uniformBuffer, VkDeviceSize uniformRange)
+{
+	if (temporalPhases == 1)
+		return;
+
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = uniformBuffer;
+	bufferInfo.offset = 0; //Start of the block is given by the dynamic offset
+	bufferInfo.range = uniformRange;
+	VkDescriptorImageInfo horizontalInfo = { sampler, horizontalView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo depthInfo = { sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo normalInfo = { sampler, normalView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo motionInfo = { sampler, motionView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+	size_t count = historyImages.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		//Writes image i, reads the one written the frame before
+		VkDescriptorImageInfo previousInfo = { sampler, historyImageViews[(i + count - 1) % count], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		VkDescriptorImageInfo currentInfo = { sampler, historyImageViews[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+		//Temporal set binding 1 the horizontal result, 2 depth, 3 history, 4 normals and 5 motion. The composite set only needs binding 1
+		std::array<VkWriteDescriptorSet, 8> descriptorWrites = {};
+		for (int w = 0; w < 8; w++)
+		{
+			int b = w < 6 ? w : w - 6;
+			VkWriteDescriptorSet& write = descriptorWrites[w];
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = w < 6 ? temporalSets[i] : historyCompositeSets[i];
+			write.dstBinding = b;
+			write.dstArrayElement = 0;
+			write.descriptorCount = 1;
+			write.descriptorType = b == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		}
+		descriptorWrites[0].pBufferInfo = &bufferInfo;
+		descriptorWrites[1].pImageInfo = &horizontalInfo;
+		descriptorWrites[2].pImageInfo = &depthInfo;
+		descriptorWrites[3].pImageInfo = &previousInfo;
+		descriptorWrites[4].pImageInfo = &normalInfo;
+		descriptorWrites[5].pImageInfo = &motionInfo;
+		descriptorWrites[6].pBufferInfo = &bufferInfo;
+		descriptorWrites[7].pImageInfo = &currentInfo;
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	}
+}
+
+void SubsurfacePass::CmdPrepareCompute(VkCommandBuffer commandBuffer)
+{
+	//The GBuffer resolve has already moved the colour and normals to shader read only, only their writes need to be made visible
+	VkMemoryBarrier gbufferBarrier = {};
+	gbufferBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	gbufferBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	gbufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	//Both targets are fully overwritten, so their old contents can be dropped. Waits for last frame's reads of them
+	std::array<VkImageMemoryBarrier, 2> targetBarriers = {};
+	for (int i = 0; i < 2; i++)
+	{
+		targetBarriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		targetBarriers[i].srcAccessMask = 0;
+		targetBarriers[i].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		targetBarriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		targetBarriers[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		targetBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		targetBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		targetBarriers[i].image = blurImages[i];
+		targetBarriers[i].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	}
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &gbufferBarrier, 0, nullptr, static_cast<uint32_t>(targetBarriers.size()), targetBarriers.data());
+}
+
+void SubsurfacePass::CmdClassifyTiles(VkCommandBuffer commandBuffer)
+{
+	//Last frame's blur may still be reading the arguments and tiles
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = tileBuffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	//No tiles yet, a dispatch of 0 x 1 x 1 groups
+	glm::uvec4 arguments = glm::uvec4(0, 1, 1, 0);
+	vkCmdUpdateBuffer(commandBuffer, tileBuffer, 0, sizeof(arguments), &arguments);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, classifyPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, classifyPipelineLayout, 0, 1, &classifySet, 0, nullptr);
+	vkCmdDispatch(commandBuffer, (m_ComputeExtent.width + CLASSIFY_TILE - 1) / CLASSIFY_TILE, (m_ComputeExtent.height + CLASSIFY_TILE - 1) / CLASSIFY_TILE, 1);
+
+	//Both blur directions read the count as their dispatch size and the tiles in the shader
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void SubsurfacePass::CmdDispatchBlur(VkCommandBuffer commandBuffer, bool vertical)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	//The vertical blur reads the horizontal result
+	if (vertical)
+	{
+		barrier.image = blurImages[0];
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	int index = vertical ? 1 : 0;
+	glm::ivec2 direction = vertical ? glm::ivec2(0, 1) : glm::ivec2(1, 0);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tiled ? tileBlurPipeline : computePipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &computeSets[index], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(direction), &direction);
+
+	if (tiled)
+	{
+		//One workgroup per listed tile, counted by the classification pass
+		vkCmdDispatchIndirect(commandBuffer, tileBuffer, 0);
+	}
+	else
+	{
+		//One workgroup per tile of a row (or column), one row of workgroups per row (or column)
+		uint32_t length = vertical ? m_ComputeExtent.height : m_ComputeExtent.width;
+		uint32_t lines = vertical ? m_ComputeExtent.width : m_ComputeExtent.height;
+		vkCmdDispatch(commandBuffer, (length + BLUR_TILE - 1) / BLUR_TILE, lines, 1);
+	}
+
+	//The composite pass samples the vertical result
+	if (vertical)
+	{
+		barrier.image = blurImages[1];
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+}
@@ -0,0 +1,61 @@
+#include "UniformRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+void UniformRing::SetAlignment(VkPhysicalDevice physicalDevice)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	//Always a power of two, blocks may also be bound as storage buffers so take the larger of the two
+	m_Alignment = std::max(properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment);
+	if (m_Alignment == 0)
+		m_Alignment = 1;
+	m_FrameSize = 0;
+}
+
+VkDeviceSize UniformRing::Reserve(VkDeviceSize size)
+{
+	if (m_Buffer != VK_NULL_HANDLE) {
+		throw std::runtime_error("uniform ring blocks must be reserved before it is created!");
+	}
+
+	VkDeviceSize offset = m_FrameSize;
+	m_FrameSize += align(size);
+	return offset;
+}
+
+void UniformRing::Create(VulkanEngine* engine, VkDevice device, uint32_t frameCount, VkBufferUsageFlags usage)
+{
+	m_Device = device;
+	m_FrameCount = frameCount;
+
+	//Every region starts aligned, as m_FrameSize is a sum of aligned blocks
+	engine->createBuffer(m_FrameSize * frameCount, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_Buffer, m_Memory);
+
+	//Map once, coherent memory needs no flushing so the pointer stays valid until clean up
+	void* data;
+	if (vkMapMemory(m_Device, m_Memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+		throw std::runtime_error("failed to map uniform ring!");
+	}
+	m_Mapped = static_cast<char*>(data);
+}
+
+void UniformRing::CleanUp()
+{
+	if (m_Buffer == VK_NULL_HANDLE)
+		return;
+
+	vkUnmapMemory(m_Device, m_Memory);
+	vkDestroyBuffer(m_Device, m_Buffer, nullptr);
+	vkFreeMemory(m_Device, m_Memory, nullptr);
+	m_Buffer = VK_NULL_HANDLE;
+	m_Memory = VK_NULL_HANDLE;
+	m_Mapped = nullptr;
+}
+
+void UniformRing::Write(uint32_t frame, VkDeviceSize block, const void* data, VkDeviceSize size)
+{
+	memcpy(m_Mapped + Offset(frame, block), data, static_cast<size_t>(size));
+}
@@ -7,6 +7,21 @@ static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
 	app->framebufferResized = true;
 }
 
+static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+
+	//B switches the subsurface scattering between the separable and Burley blurs
+	if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+		auto app = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window));
+		app->subsurfaceModeChanged = true;
+	}
+}
+
+
+//Integer GBuffer targets, their resolve copies one sample where the float targets would average the surfaces at an edge
+static const VkFormat GBUFFER_NORMAL_FORMAT = VK_FORMAT_A2B10G10R10_UINT_PACK32;
+static const VkFormat GBUFFER_DEPTH_FORMAT = VK_FORMAT_R32_UINT;
+//The frame index is passed to the shaders wrapped at a multiple of every temporal phase count (1 to 8), so it stays exact as a float
+static const uint32_t TEMPORAL_INDEX_PERIOD = 840;
 
 static std::vector<char> readFile(const std::string& filename) {
 
@@ -30,10 +45,11 @@ static std::vector<char> readFile(const std::string& filename) {
 
 const void VulkanApp::initWindow()
 {
-	window = new GLFW_Window(1280, 720, "Subsurface Scattering"); //Open the GLFW window with a given size and name
+	window = new GLFW_Window(settings.width, settings.height, "Subsurface Scattering"); //Open the GLFW window with a given size and name
 
 	glfwSetWindowUserPointer(window->Window(), this); //Set the window pointer to this class (VulkanApp)
 	glfwSetFramebufferSizeCallback(window->Window(), framebufferResizeCallback); //Set resize call back to given function
+	glfwSetKeyCallback(window->Window(), keyCallback);
 }
 
 const void VulkanApp::initVulkan() {
@@ -43,16 +59,30 @@ const void VulkanApp::initVulkan() {
 	createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
+	createGpuProfiler();
 	createSwapChain();
 	createImageViews();
 	createRenderPass();
 	createCommandPool();
+	createCommandRecorder();
+	subsurfaceManager.mergeTaps = settings.subsurfaceBilinear && !settings.computeSubsurface; //The compute blur fetches whole pixels
+	subsurfaceManager.packedDepth = settings.subsurfacePackedDepth && !settings.computeSubsurface; //The compute blur caches its taps in shared memory
+	subsurfaceManager.SetSampleCount(settings.subsurfaceSamples);
+	subsurfaceManager.resolutionScale = settings.subsurfaceScale;
+	subsurfaceManager.temporalPhases = settings.computeSubsurface ? 1 : settings.subsurfaceTemporalPhases; //Only the raster passes keep a history
+	subsurfaceManager.tiled = settings.subsurfaceTiles;
+	subsurfaceManager.adaptive = settings.subsurfaceAdaptive && !settings.computeSubsurface; //Only the raster blur picks its kernel per pixel
+	subsurfaceManager.burley = settings.burleySubsurface;
 	createColorResources();
+	createDepthResources();
 	CreateSSFrameBuffer();
 	prepareGOffscreenFramebuffer();
+	prepareLightingFramebuffer();
 	createDescriptorSetLayout();
 	prepareOffscreenFramebuffer();
 	createGraphicsPipeline();
+	createCullPipeline();
+	createSubsurfaceComputePipeline();
 	
 
 
@@ -61,32 +91,36 @@ const void VulkanApp::initVulkan() {
 
 	
 
-	m_Objects.push_back(new VulkanObject(m_Engine, device, graphicsQueue, commandPool, "models/plane.obj", "textures/Background.png", "textures/white.png", "textures/white.png"));
+	m_Objects.push_back(new VulkanObject(&geometryArena, "models/plane.obj", getMaterial("textures/Background.png", "textures/white.png", "textures/white.png")));
 	m_Objects[0]->SetPos(glm::vec3(0.0f, -2.5f, -25));
 	m_Objects[0]->SetRot(glm::vec3(0, 0.0f, 0));
 	m_Objects[0]->SetScale(glm::vec3(24.0f, 13.5f, 1.5f));
 	m_Objects[0]->SetLit(false);
 
-	m_Objects.push_back(new VulkanObject(m_Engine, device, graphicsQueue, commandPool, "models/headLow.obj", "textures/headC.jpg", "textures/headN.jpg", "textures/headS.jpg"));
+	m_Objects.push_back(new VulkanObject(&geometryArena, "models/headLow.obj", getMaterial("textures/headC.jpg", "textures/headN.jpg", "textures/headS.jpg")));
 	m_Objects[1]->SetPos(glm::vec3(0.0f, -0.135, 0));
 	m_Objects[1]->SetRot(glm::vec3(0, 0.0f, 0));
 	m_Objects[1]->SetScale(glm::vec3(0.175f, 0.175f, 0.175f));
 
 	
 
-	m_Objects.push_back(new VulkanObject(m_Engine, device, graphicsQueue, commandPool, "models/Light.obj", "textures/white.png", "textures/handN.png", "textures/handS.png"));
+	m_Objects.push_back(new VulkanObject(&geometryArena, "models/Light.obj", getMaterial("textures/white.png", "textures/handN.png", "textures/handS.png")));
 	m_Objects[2]->SetPos(glm::vec3(0.0f, -0.15f, 0));
 	m_Objects[2]->SetRot(glm::vec3(0, 0.0f, 0));
 	m_Objects[2]->SetScale(glm::vec3(0.02f, 0.02f, 0.02f));
 	m_Objects[2]->SetLit(false);
+	//The light does not cast a shadow
+	m_Objects[2]->SetCastsShadow(false);
 
+	//Every mesh is loaded, move them all into the shared buffers
+	geometryArena.Upload(m_Engine, device, graphicsQueue, commandPool);
 	
 
 	
-	createDepthResources();
 	createFramebuffers();
 	
 	createUniformBuffers();
+	createDrawCommands();
 	createDescriptorPool();
 	createDescriptorSets();
 	createCommandBuffers();
@@ -116,16 +150,6 @@ const void VulkanApp::createInstance()
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	createInfo.pApplicationInfo = &appInfo;
 
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-
-	//Get required  instance extention
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-	//Pass extention count and names to info
-	createInfo.enabledExtensionCount = glfwExtensionCount;
-	createInfo.ppEnabledExtensionNames = glfwExtensions;
-
 	createInfo.enabledLayerCount = 0;
 
 	//If using validation layers pass in validation data to info
@@ -213,14 +237,92 @@ const void VulkanApp::mainLoop() {
 	vkDeviceWaitIdle(device);
 }
 
+const void VulkanApp::benchmarkLoop() {
+	FrameStatistics frameTimes;
+	frameTimes.reserve(settings.benchmarkFrames);
+
+	uint32_t totalFrames = settings.warmupFrames + settings.benchmarkFrames;
+	auto lastTime = std::chrono::steady_clock::now();
+
+	for (uint32_t i = 0; i < totalFrames; i++)
+	{
+		drawFrame();
+
+		//Time between frame submissions, once the frames in flight are full this is paced by the GPU
+		auto currentTime = std::chrono::steady_clock::now();
+		float ms = std::chrono::duration<float, std::milli>(currentTime - lastTime).count();
+		lastTime = currentTime;
+
+		//Skip the warm up frames (pipeline/driver caches still filling)
+		if (i >= settings.warmupFrames)
+			frameTimes.record(ms);
+		else if (i + 1 == settings.warmupFrames)
+			gpuProfiler.ClearStatistics();
+	}
+	//Wait for last frame to be processed before ending
+	vkDeviceWaitIdle(device);
+
+	//Read back the frames still in flight
+	for (size_t i = 0; i < profiledSets.size(); i++)
+		gpuProfiler.Collect(profiledSets[i]);
+
+	frameTimes.report(std::cout, "Frame time");
+	gpuProfiler.ReportSummary(std::cout);
+}
+
+void VulkanApp::updateClock() {
+
+	//Headless runs advance a fixed amount each frame so every run animates identically
+	if (settings.headless)
+	{
+		realTime = simulatedFrames * settings.fixedTimestep;
+		simulatedFrames++;
+		return;
+	}
+
+	//Time at start of frame
+	static auto startTime = std::chrono::high_resolution_clock::now();
+
+	//Current time
+	auto currentTime = std::chrono::high_resolution_clock::now();
+	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+	//Delta Time
+	timercount += time - realTime;
+	realTime = time;
+
+	if (timercount >= 1)
+	{
+		timercount = 0;
+		std::cout << framecount << '\r' << std::endl;
+		framecount = 0;
+	}
+}
+
 void VulkanApp::drawFrame() {
 	
+	//Between frames, as every recorded command buffer holds the blur
+	if (subsurfaceModeChanged) {
+		subsurfaceModeChanged = false;
+		switchSubsurfaceMode();
+	}
+
 	//Wait for current frame to be processed before drawing a new one (stop memory leak)
 	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
 
+	//The last submission from this frame has finished, so its timestamps can be read without waiting
+	gpuProfiler.Collect(profiledSets[currentFrame]);
+
 	//Get next image to render too, if failed recreate swap chain and wait till next frame
 	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	VkResult result = VK_SUCCESS;
+	if (settings.headless) {
+		//No swap chain, cycle through the offscreen targets
+		imageIndex = static_cast<uint32_t>(currentFrame % swapChainImages.size());
+	}
+	else {
+		result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	}
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		recreateSwapChain();
@@ -230,30 +332,39 @@ void VulkanApp::drawFrame() {
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
 
+	//Advance the clock once so every object sees the same time this frame
+	updateClock();
+	updateFrameUniforms(static_cast<uint32_t>(currentFrame));
+
 	for (unsigned int j = 0; j < m_Objects.size(); j++)
 	{
-		//Update shader buffers
-		updateUniformBuffer(imageIndex, j);
+		//Update shader buffers, this frame's region of the ring is free now its fence has signaled
+		updateUniformBuffer(static_cast<uint32_t>(currentFrame), j);
 	}
+	cullObjects();
 	framecount++;
+	frameIndex++;
 	//Set up submit info
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
 	//Pass in sync data (semiphores)
+	//(Headless frames have no image to wait on or present, so skip the semaphores)
 	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.waitSemaphoreCount = settings.headless ? 0 : 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
 	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.signalSemaphoreCount = settings.headless ? 0 : 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	//Pass in command buffer data
+	//Pass in command buffer data, recorded with this frame's uniform offsets and image's frame buffer
+	uint32_t commandIndex = static_cast<uint32_t>(currentFrame * swapChainImages.size() + imageIndex);
+	VkCommandBuffer commandBuffer = settings.recordEachFrame ? recordFrame(static_cast<uint32_t>(currentFrame), imageIndex, commandIndex) : commandBuffers[commandIndex];
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+	submitInfo.pCommandBuffers = &commandBuffer;
 
 	//Reset wait fence 
 	vkResetFences(device, 1, &inFlightFences[currentFrame]);
@@ -263,7 +374,14 @@ void VulkanApp::drawFrame() {
 	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
 		throw std::runtime_error("failed to submit draw command buffer!");
 	}
+	gpuProfiler.Submitted(commandIndex);
+	profiledSets[currentFrame] = commandIndex;
 
+	//Nothing to present when headless
+	if (settings.headless) {
+		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		return;
+	}
 
 	//Set up presentation settings
 	VkPresentInfoKHR presentInfo = {};
@@ -306,27 +424,27 @@ const void VulkanApp::cleanup() {
 
 	//Clean up layout memory
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, materialSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, lightingPass.setLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, frameSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+	//Clean up the culling pre-pass
+	vkDestroyPipeline(device, cullPipeline, nullptr);
+	vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+	subsurfaceManager.CleanUpCompute(device);
 	//Clean up shader buffers
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		for (unsigned int j = 0; j < m_Objects.size(); j++)
-		{
-			unsigned int index = m_Objects.size() * i + j;
-			vkDestroyBuffer(device, uniformBuffers[index], nullptr);
-			vkFreeMemory(device, uniformBuffersMemory[index], nullptr);
-		}
-	}
-	for (unsigned int j = 0; j < m_Objects.size(); j++)
-	{
-		vkDestroyBuffer(device, offscreenUniforms[j], nullptr);
-		vkFreeMemory(device, offscreenMemorys[j], nullptr);
-		
-	}
+	uniformRing.CleanUp();
+	vkDestroyBuffer(device, drawCommandBuffer, nullptr);
+	vkFreeMemory(device, drawCommandMemory, nullptr);
+	geometryArena.CleanUp();
 	vkDestroyImage(device, offscreenPass.depth.image, nullptr);
 	vkDestroySampler(device, offscreenPass.depthSampler, nullptr);
+	vkDestroySampler(device, offscreenPass.shadowSampler, nullptr);
 
-	delete m_Objects[0];
-	delete m_Objects[1];
-	delete m_Objects[2];
+	for (size_t i = 0; i < m_Objects.size(); i++)
+		delete m_Objects[i];
+	for (size_t i = 0; i < m_Materials.size(); i++)
+		delete m_Materials[i];
 	
 
 	vkDestroyImageView(device, offscreenPass.depth.view, nullptr);
@@ -343,15 +461,13 @@ const void VulkanApp::cleanup() {
 
 	//clean up command pools
 	vkDestroyCommandPool(device, commandPool, nullptr);
+	commandRecorder.CleanUp();
 
 	//Clean up GBuffer
 	CleanGBuffer();
-	vkDestroyBuffer(device, GBUniform, nullptr);
-	vkFreeMemory(device, GBUniformMemory, nullptr);
-
 
-	//Clean up sss
-	subsurfaceManager.CleanUp(device);
+	//Clean up profiler
+	gpuProfiler.CleanUp();
 
 	//Clean up device
 	vkDestroyDevice(device, nullptr);
@@ -363,22 +479,27 @@ const void VulkanApp::cleanup() {
 	}
 
 	//Clean up instance.surface
-	vkDestroySurfaceKHR(instance, surface, nullptr);
+	if (!settings.headless)
+		vkDestroySurfaceKHR(instance, surface, nullptr);
 	vkDestroyInstance(instance, nullptr);
 
 	//Clean up glfw window
-	delete window;
+	if (!settings.headless)
+		delete window;
 }
 
 std::vector<const char*> VulkanApp::getRequiredExtensions() {
 
-	//Get extention count
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
 	//Allocate vector memory
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	std::vector<const char*> extensions;
+
+	//Get the extentions glfw needs to present to a window (none when headless)
+	if (!settings.headless) {
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
 
 	//Add extention names too vector
 	if (enableValidationLayers) {
@@ -482,9 +603,9 @@ bool VulkanApp::isDeviceSuitable(VkPhysicalDevice device) {
 	//Check tha all extentions needed are supported
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-	//Make sure the swap chain is supported on the device
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	//Make sure the swap chain is supported on the device (not needed when headless)
+	bool swapChainAdequate = settings.headless;
+	if (extensionsSupported && !settings.headless) {
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
@@ -498,6 +619,11 @@ bool VulkanApp::isDeviceSuitable(VkPhysicalDevice device) {
 
 bool VulkanApp::checkDeviceExtensionSupport(VkPhysicalDevice device) {
 
+	//Headless rendering does not present, so no device extentions are required
+	if (settings.headless) {
+		return true;
+	}
+
 	//Get extention count
 	uint32_t extensionCount;
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -537,9 +663,12 @@ VulkanApp::QueueFamilyIndices VulkanApp::findQueueFamilies(VkPhysicalDevice devi
 		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
 			indices.graphicsFamily = i;
 		}
-		//Check if the support is present
+		//Check if the support is present (headless never presents, so the graphics queue is used)
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		if (settings.headless)
+			presentSupport = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+		else
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
 
 		//IF support is found and queue count is greater than 0 update presentFamily
 		if (queueFamily.queueCount > 0 && presentSupport) {
@@ -579,10 +708,28 @@ void VulkanApp::createLogicalDevice() {
 
 
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 
 	deviceFeatures.wideLines = VK_TRUE;
 
+	//Without multi draw each indirect command is its own call, still recorded once
+	multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+
+	//Indirect draws find their object through firstInstance, without it fall back to recording each frame with CPU culling
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	if (supportedFeatures.drawIndirectFirstInstance != VK_TRUE && !settings.recordEachFrame) {
+		std::cout << "drawIndirectFirstInstance not supported, recording command buffers each frame" << std::endl;
+		settings.recordEachFrame = true;
+	}
+
+	//Only used to count the GBuffer's fragment shader invocations
+	pipelineStatistics = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+	deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+
 	//Set up logical device info
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -594,8 +741,8 @@ void VulkanApp::createLogicalDevice() {
 	//Set Enabled devices features
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
-	//Set extentions
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+	//Set extentions (the swap chain extention is not needed when headless)
+	createInfo.enabledExtensionCount = settings.headless ? 0 : static_cast<uint32_t>(deviceExtensions.size());
 	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 
@@ -619,6 +766,11 @@ void VulkanApp::createLogicalDevice() {
 
 void VulkanApp::createSurface() {
 
+	//No window to render too when headless
+	if (settings.headless) {
+		return;
+	}
+
 	//Create window rendering surface using vulkan instance infomation 
 	if (glfwCreateWindowSurface(instance, window->Window(), nullptr, &surface) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create window surface!");
@@ -707,8 +859,30 @@ VkExtent2D VulkanApp::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilit
 	}
 }
 
+void VulkanApp::createGpuProfiler() {
+
+	//Timestamps are written by the graphics queue, check how many bits it supports
+	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	//Fragments are not counted when recording each frame, the query would have to be inherited by the secondary buffers
+	bool countFragments = pipelineStatistics && !settings.recordEachFrame;
+	gpuProfiler.Create(physicalDevice, device, queueFamilies[indices.graphicsFamily.value()].timestampValidBits, countFragments, settings.gpuReportInterval, settings.gpuCsvPath);
+	profiledSets.assign(MAX_FRAMES_IN_FLIGHT, 0);
+}
+
 void VulkanApp::createSwapChain() {
 
+	//Render into offscreen images instead when headless
+	if (settings.headless) {
+		createHeadlessTargets();
+		return;
+	}
+
 	//Check for swap chain support data
 	SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 
@@ -774,6 +948,20 @@ void VulkanApp::createSwapChain() {
 	swapChainExtent = extent;
 }
 
+void VulkanApp::createHeadlessTargets() {
+
+	//Use the same format the swap chain prefers so every render pass and pipeline is unchanged
+	swapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+	swapChainExtent = { settings.width, settings.height };
+
+	//One target per frame in flight so a frame never renders into an image the previous frame is using
+	swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+	headlessImageMemory.resize(MAX_FRAMES_IN_FLIGHT);
+	for (size_t i = 0; i < swapChainImages.size(); i++) {
+		m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], headlessImageMemory[i], VK_SAMPLE_COUNT_1_BIT);
+	}
+}
+
 void VulkanApp::createImageViews() {
 	
 	//Allocate enough memory for each image
@@ -885,10 +1073,10 @@ void VulkanApp::createGraphicsPipeline() {
 	depthStencil.minDepthBounds = 0.0f; // Optional
 	depthStencil.maxDepthBounds = 1.0f; // Optional
 
-	//Set up colour blending settings (Default blending settings)
+	//Set up colour blending settings, the GBuffer holds surface data rather than colour so nothing is blended
 	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
 	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_TRUE;
+	colorBlendAttachment.blendEnable = VK_FALSE;
 	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
 	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
 	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
@@ -900,8 +1088,8 @@ void VulkanApp::createGraphicsPipeline() {
 	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 	colorBlending.logicOpEnable = VK_FALSE;
 	colorBlending.logicOp = VK_LOGIC_OP_COPY;
-	colorBlending.attachmentCount = 3;
-	std::array<VkPipelineColorBlendAttachmentState, 3> blendAttachmentStates = { colorBlendAttachment ,colorBlendAttachment ,colorBlendAttachment };
+	colorBlending.attachmentCount = 4;
+	std::array<VkPipelineColorBlendAttachmentState, 4> blendAttachmentStates = { colorBlendAttachment ,colorBlendAttachment ,colorBlendAttachment ,colorBlendAttachment };
 	colorBlending.pAttachments = blendAttachmentStates.data();
 	colorBlending.blendConstants[0] = 0.0f;
 	colorBlending.blendConstants[1] = 0.0f;
@@ -911,8 +1099,9 @@ void VulkanApp::createGraphicsPipeline() {
 	//Layout info (mainly default)
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, frameSetLayout }; //Set 0 per screen space pass, set 1 per frame
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
 
 	std::vector<VkDynamicState> dynamicStateEnables = {
 			VK_DYNAMIC_STATE_VIEWPORT,
@@ -929,8 +1118,20 @@ void VulkanApp::createGraphicsPipeline() {
 	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create pipeline layout!");
 	}
-	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &offscreenPipelineLayout) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create offscreen pipeline layout!");
+	//The lighting subpass swaps set 0 for its input attachments
+	if (settings.gbufferSubpasses)
+	{
+		std::array<VkDescriptorSetLayout, 2> lightingSetLayouts = { lightingPass.setLayout, frameSetLayout };
+		pipelineLayoutInfo.pSetLayouts = lightingSetLayouts.data();
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &lightingPass.pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create lighting pipeline layout!");
+		}
+	}
+	//Scene passes swap set 0 for the material textures, the object data sits in set 1
+	std::array<VkDescriptorSetLayout, 2> sceneSetLayouts = { materialSetLayout, frameSetLayout };
+	pipelineLayoutInfo.pSetLayouts = sceneSetLayouts.data();
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &scenePipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create scene pipeline layout!");
 	}
 
 	//Set up graphics pipline info
@@ -945,24 +1146,44 @@ void VulkanApp::createGraphicsPipeline() {
 	pipelineInfo.pRasterizationState = &rasterizer;
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.layout = pipelineLayout;
+	pipelineInfo.layout = scenePipelineLayout;
 	pipelineInfo.renderPass = offScreenFrameBuf.renderPass;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; //Only going to be using one pipline for now, dont need to refrence the base
 	pipelineInfo.pDepthStencilState = &depthStencil;
 	pipelineInfo.pDynamicState = &dynamicState;
 
-	uint32_t enablePCF = 1;
-	VkSpecializationMapEntry specializationMapEntry{};
-	specializationMapEntry.constantID = 0;
-	specializationMapEntry.offset = 0;
-	specializationMapEntry.size = sizeof(uint32_t);
-	VkSpecializationInfo specializationInfo{};
-	specializationInfo.mapEntryCount = 1;
-	specializationInfo.pMapEntries = &specializationMapEntry;
-	specializationInfo.dataSize = sizeof(uint32_t);
-	specializationInfo.pData = &enablePCF;
-	shaderStages[1].pSpecializationInfo = &specializationInfo;
+	//Depth only pre-pass, the same transform reading just the positions and writing no colour
+	if (settings.depthPrePass)
+	{
+		auto vertShaderCodeDepth = readFile("shaders/vertDepth.spv");
+		VkShaderModule depthShaderModule = createShaderModule(vertShaderCodeDepth);
+		VkPipelineShaderStageCreateInfo depthShaderStageInfo = vertShaderStageInfo;
+		depthShaderStageInfo.module = depthShaderModule;
+
+		VkPipelineVertexInputStateCreateInfo positionInputInfo = vertexInputInfo;
+		positionInputInfo.vertexAttributeDescriptionCount = 1; //Position is the first attribute
+
+		std::array<VkPipelineColorBlendAttachmentState, 4> depthBlendAttachmentStates = blendAttachmentStates;
+		for (VkPipelineColorBlendAttachmentState& state : depthBlendAttachmentStates)
+			state.colorWriteMask = 0;
+		VkPipelineColorBlendStateCreateInfo depthColorBlending = colorBlending;
+		depthColorBlending.pAttachments = depthBlendAttachmentStates.data();
+
+		VkGraphicsPipelineCreateInfo depthPipelineInfo = pipelineInfo;
+		depthPipelineInfo.stageCount = 1;
+		depthPipelineInfo.pStages = &depthShaderStageInfo;
+		depthPipelineInfo.pVertexInputState = &positionInputInfo;
+		depthPipelineInfo.pColorBlendState = &depthColorBlending;
+		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &depthPipelineInfo, nullptr, &depthPrePassPipeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pre-pass pipeline!");
+		}
+		vkDestroyShaderModule(device, depthShaderModule, nullptr);
+
+		//Every pixel already holds its nearest depth, so only the fragments of the visible surface pass
+		depthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+		depthStencil.depthWriteEnable = VK_FALSE;
+	}
 
 	//Create pipeline and error check
 	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &GBufferGraphicsPipeline) != VK_SUCCESS) {
@@ -970,50 +1191,97 @@ void VulkanApp::createGraphicsPipeline() {
 	}
 	vkDestroyShaderModule(device, fragShaderModule, nullptr);
 	vkDestroyShaderModule(device, vertShaderModule, nullptr);
-	pipelineInfo.renderPass = subsurfaceManager.SSRenderPass;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-
-	auto vertShaderCodeR = readFile("shaders/vertR.spv");
-	auto fragShaderCodeR = readFile("shaders/fragR.spv");
-	//Set up shader modules for both vertex and fragment shaders
-	vertShaderModule = createShaderModule(vertShaderCodeR);
-	fragShaderModule = createShaderModule(fragShaderCodeR);
-
-	//Set up vertex info
-	vertShaderStageInfo = {};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT; //Vertex stage
-	vertShaderStageInfo.module = vertShaderModule; //Vertex shader
-	vertShaderStageInfo.pName = "main"; //Main function as entry point
-
-	//Set up fragment info
-	fragShaderStageInfo = {};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT; //Fragment stage
-	fragShaderStageInfo.module = fragShaderModule; //Fragment shader
-	fragShaderStageInfo.pName = "main"; //Main function as entry point
 
-	shaderStages[0] = vertShaderStageInfo;
-	shaderStages[1] = fragShaderStageInfo;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	//Create pipeline and error check
-	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create graphics pipeline!");
+	//Lighting pass, the shadow filter (0), whether the depth is packed into the colour target's alpha (1) and the filter's tap count (2)
+	std::array<uint32_t, 3> specializationData = { settings.shadowFilter, subsurfaceManager.packedDepth ? VK_TRUE : VK_FALSE, settings.shadowTaps };
+	std::array<VkSpecializationMapEntry, 3> specializationMapEntries{};
+	for (uint32_t i = 0; i < specializationMapEntries.size(); i++)
+	{
+		specializationMapEntries[i].constantID = i;
+		specializationMapEntries[i].offset = i * sizeof(uint32_t);
+		specializationMapEntries[i].size = sizeof(uint32_t);
 	}
-	pipelineInfo.renderPass = renderPass;
-	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &subsurfaceManager.SSGraphicsPipeline) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create graphics pipeline!");
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationMapEntries.size());
+	specializationInfo.pMapEntries = specializationMapEntries.data();
+	specializationInfo.dataSize = sizeof(uint32_t) * specializationData.size();
+	specializationInfo.pData = specializationData.data();
+	if (settings.gbufferSubpasses)
+	{
+		auto fragShaderCodeLighting = readFile("shaders/fragLightingSubpass.spv");
+		fragShaderModule = createShaderModule(fragShaderCodeLighting);
+		createPostProcessPipeline(fragShaderModule, offScreenFrameBuf.renderPass, lightingPass.pipeline, nullptr, &specializationInfo, lightingPass.pipelineLayout, 1);
+	}
+	else
+	{
+		auto fragShaderCodeLighting = readFile("shaders/fragLighting.spv");
+		fragShaderModule = createShaderModule(fragShaderCodeLighting);
+		createPostProcessPipeline(fragShaderModule, lightingPass.renderPass, lightingPass.pipeline, nullptr, &specializationInfo);
 	}
-	//Destroy shader modules now we have finished with them
 	vkDestroyShaderModule(device, fragShaderModule, nullptr);
-	vkDestroyShaderModule(device, vertShaderModule, nullptr);
-
 
+	//Stencil 1 marks pixels that are not subsurface scattered, they are copied instead of blurred
+	VkStencilOpState maskStencil = {};
+	maskStencil.failOp = VK_STENCIL_OP_KEEP;
+	maskStencil.passOp = VK_STENCIL_OP_REPLACE;
+	maskStencil.depthFailOp = VK_STENCIL_OP_KEEP;
+	maskStencil.compareOp = VK_COMPARE_OP_ALWAYS;
+	maskStencil.compareMask = 0xff;
+	maskStencil.writeMask = 0xff;
+	maskStencil.reference = 1;
+	VkStencilOpState copyStencil = maskStencil;
+	copyStencil.passOp = VK_STENCIL_OP_KEEP;
+	copyStencil.compareOp = VK_COMPARE_OP_EQUAL;
+	copyStencil.writeMask = 0;
+	VkStencilOpState blurStencil = copyStencil;
+	blurStencil.reference = 0;
+
+	//Screen space passes, a fullscreen triangle each
+	auto fragShaderCodeR = readFile("shaders/fragR.spv");
+	fragShaderModule = createShaderModule(fragShaderCodeR);
+	createPostProcessPipeline(fragShaderModule, subsurfaceManager.SSRenderPass, graphicsPipeline, &blurStencil, subsurfaceManager.BlurSpecialization());
+	createPostProcessPipeline(fragShaderModule, renderPass, subsurfaceManager.SSGraphicsPipeline, &blurStencil, subsurfaceManager.BlurSpecialization());
+	//Vertical blur blended with the reprojected history
+	if (subsurfaceManager.temporalPhases > 1)
+		createPostProcessPipeline(fragShaderModule, subsurfaceManager.historyRenderPass, subsurfaceManager.temporalPipeline, &blurStencil, subsurfaceManager.BlurSpecialization(true));
+	vkDestroyShaderModule(device, fragShaderModule, nullptr);
 
+	//Copies pixels without subsurface scattering, discarding the rest so their stencil stays 0
+	auto fragShaderCodeMask = readFile("shaders/fragMask.spv");
+	fragShaderModule = createShaderModule(fragShaderCodeMask);
+	createPostProcessPipeline(fragShaderModule, subsurfaceManager.SSRenderPass, subsurfaceManager.maskPipeline, &maskStencil);
+	createPostProcessPipeline(fragShaderModule, renderPass, subsurfaceManager.copyPipeline, &copyStencil);
+	if (subsurfaceManager.temporalPhases > 1)
+		createPostProcessPipeline(fragShaderModule, subsurfaceManager.historyRenderPass, subsurfaceManager.historyCopyPipeline, &copyStencil);
+	vkDestroyShaderModule(device, fragShaderModule, nullptr);
 
+	//Brings a reduced resolution blur back to full resolution, the render passes are compatible so the pipelines above are reused at either size
+	if (subsurfaceManager.resolutionScale > 1)
+	{
+		auto fragShaderCodeUpsample = readFile("shaders/fragUpsample.spv");
+		fragShaderModule = createShaderModule(fragShaderCodeUpsample);
+		createPostProcessPipeline(fragShaderModule, renderPass, subsurfaceManager.upsamplePipeline);
+		vkDestroyShaderModule(device, fragShaderModule, nullptr);
+	}
 
+	//Burley disk blur, always created so the blur can be switched while running
+	auto fragShaderCodeBurley = readFile("shaders/fragBurley.spv");
+	fragShaderModule = createShaderModule(fragShaderCodeBurley);
+	createPostProcessPipeline(fragShaderModule, renderPass, subsurfaceManager.burleyPipeline, nullptr, subsurfaceManager.BlurSpecialization());
+	vkDestroyShaderModule(device, fragShaderModule, nullptr);
 
+	//Copies the compute blur's result into the swap chain image, taking pixels outside the blurred tiles from the GBuffer
+	VkBool32 compositeTiled = subsurfaceManager.tiled ? VK_TRUE : VK_FALSE;
+	VkSpecializationMapEntry compositeEntry = { 0, 0, sizeof(VkBool32) };
+	VkSpecializationInfo compositeSpecialization = {};
+	compositeSpecialization.mapEntryCount = 1;
+	compositeSpecialization.pMapEntries = &compositeEntry;
+	compositeSpecialization.dataSize = sizeof(VkBool32);
+	compositeSpecialization.pData = &compositeTiled;
+	auto fragShaderCodeComposite = readFile("shaders/fragComposite.spv");
+	fragShaderModule = createShaderModule(fragShaderCodeComposite);
+	createPostProcessPipeline(fragShaderModule, renderPass, subsurfaceManager.compositePipeline, nullptr, &compositeSpecialization);
+	vkDestroyShaderModule(device, fragShaderModule, nullptr);
 
 	auto vertShaderCodeOff = readFile("shaders/vertOff.spv");
 	auto fragShaderCodeOff = readFile("shaders/fragOff.spv");
@@ -1043,6 +1311,7 @@ void VulkanApp::createGraphicsPipeline() {
 	colorBlending.attachmentCount = 0;
 	// Cull front faces
 	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	depthStencil.depthWriteEnable = VK_TRUE; //Turned off for the GBuffer when it follows the depth pre-pass
 	// Enable depth bias
 	rasterizer.depthBiasEnable = VK_TRUE;
 	// Add depth bias to dynamic state, so we can change it at runtime
@@ -1056,13 +1325,175 @@ void VulkanApp::createGraphicsPipeline() {
 	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
 
-	pipelineInfo.layout = offscreenPipelineLayout;
+	pipelineInfo.layout = scenePipelineLayout;
 	pipelineInfo.renderPass = offscreenPass.renderPass;
 	vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &offscreenPipeline);
 	vkDestroyShaderModule(device, fragShaderModule, nullptr);
 	vkDestroyShaderModule(device, vertShaderModule, nullptr);
 }
 
+void VulkanApp::createPostProcessPipeline(VkShaderModule fragShaderModule, VkRenderPass pass, VkPipeline& pipeline, const VkStencilOpState* stencil, const VkSpecializationInfo* specialization, VkPipelineLayout layout, uint32_t subpass) {
+
+	//The triangle's corners come from the vertex index, so there are no vertex buffers
+	auto vertShaderCode = readFile("shaders/vertFS.spv");
+	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+
+	VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT; //Vertex stage
+	shaderStages[0].module = vertShaderModule;
+	shaderStages[0].pName = "main"; //Main function as entry point
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT; //Fragment stage
+	shaderStages[1].module = fragShaderModule;
+	shaderStages[1].pName = "main"; //Main function as entry point
+	shaderStages[1].pSpecializationInfo = specialization;
+
+	//No vertex input
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	//Viewport and scissor are dynamic
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	//One triangle covering the screen, nothing to cull
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	//Every pixel is written once, so depth is neither tested nor written
+	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = VK_FALSE;
+	depthStencil.depthWriteEnable = VK_FALSE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = stencil ? VK_TRUE : VK_FALSE;
+	if (stencil) {
+		depthStencil.front = *stencil;
+		depthStencil.back = *stencil;
+	}
+
+	//Opaque output, no blending
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	std::array<VkDynamicState, 2> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
+	dynamicState.pDynamicStates = dynamicStateEnables.data();
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = layout != VK_NULL_HANDLE ? layout : pipelineLayout;
+	pipelineInfo.renderPass = pass;
+	pipelineInfo.subpass = subpass;
+
+	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create post process pipeline!");
+	}
+	vkDestroyShaderModule(device, vertShaderModule, nullptr);
+}
+
+void VulkanApp::createSubsurfaceComputePipeline() {
+
+	auto blurShaderCode = readFile("shaders/sssBlur.spv");
+	VkShaderModule blurShaderModule = createShaderModule(blurShaderCode);
+	subsurfaceManager.CreateComputePipeline(device, blurShaderModule, frameSetLayout);
+	vkDestroyShaderModule(device, blurShaderModule, nullptr);
+
+	//Classification pass and the blur over the tiles it lists
+	if (subsurfaceManager.tiled)
+	{
+		auto classifyShaderCode = readFile("shaders/sssClassify.spv");
+		auto tileBlurShaderCode = readFile("shaders/sssTileBlur.spv");
+		VkShaderModule classifyShaderModule = createShaderModule(classifyShaderCode);
+		VkShaderModule tileBlurShaderModule = createShaderModule(tileBlurShaderCode);
+		subsurfaceManager.CreateTilePipelines(device, classifyShaderModule, tileBlurShaderModule);
+		vkDestroyShaderModule(device, classifyShaderModule, nullptr);
+		vkDestroyShaderModule(device, tileBlurShaderModule, nullptr);
+	}
+}
+
+void VulkanApp::createCullPipeline() {
+
+	//Compute shader that tests each object against both frustums and writes its draws
+	auto cullShaderCode = readFile("shaders/cull.spv");
+	VkShaderModule cullShaderModule = createShaderModule(cullShaderCode);
+
+	VkPipelineShaderStageCreateInfo cullShaderStageInfo = {};
+	cullShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	cullShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT; //Compute stage
+	cullShaderStageInfo.module = cullShaderModule;
+	cullShaderStageInfo.pName = "main"; //Main function as entry point
+
+	//The object count is pushed, so it does not need a uniform block
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(uint32_t);
+
+	//Set 0 the draw commands, set 1 the frame set shared with the graphics passes
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { cullSetLayout, frameSetLayout };
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = cullShaderStageInfo;
+	pipelineInfo.layout = cullPipelineLayout;
+
+	if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &cullPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline!");
+	}
+	vkDestroyShaderModule(device, cullShaderModule, nullptr);
+}
+
 VkShaderModule VulkanApp::createShaderModule(const std::vector<char>& code) {
 
 	//Set up up shader module info
@@ -1091,7 +1522,7 @@ void VulkanApp::createRenderPass() {
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; //Not using stencil buffer for this
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; //Not using stencil buffer for this
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;  //Ignore previos layout
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; //Use image in the swap buffer
+	colorAttachment.finalLayout = settings.headless ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; //Use image in the swap buffer (headless images are never presented)
 
 	VkAttachmentDescription colorAttachmentResolve = {};
 	colorAttachmentResolve.format = swapChainImageFormat;
@@ -1107,14 +1538,15 @@ void VulkanApp::createRenderPass() {
 	colorAttachmentResolveRef.attachment = 2;
 	colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	//Depth is unused, the stencil holds the subsurface mask written by the horizontal pass
 	VkAttachmentDescription depthAttachment = {};
-	depthAttachment.format = findDepthFormat();
+	depthAttachment.format = findDepthStencilFormat();
 	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	//Refrence to the attachment for the sub passes
@@ -1215,10 +1647,30 @@ void VulkanApp::createCommandPool() {
 	}
 }
 
+void VulkanApp::createCommandRecorder() {
+
+	//Only needed when the command buffers are recorded again every frame
+	if (!settings.recordEachFrame)
+		return;
+
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+	commandRecorder.Create(device, queueFamilyIndices.graphicsFamily.value(), settings.recordThreads, MAX_FRAMES_IN_FLIGHT);
+}
+
 void VulkanApp::createCommandBuffers() {
 	
+	//One command buffer per frame in flight for each frame buffer as the uniform offsets differ per frame
+	uint32_t setCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * swapChainFramebuffers.size());
+
+	//One timestamp set per (frame, image) pair, used whether the buffer is pre-recorded or recorded each frame
+	gpuProfiler.CreateQueries(setCount);
+
+	//Recorded in drawFrame instead
+	if (settings.recordEachFrame)
+		return;
+
 	//Allocate memory
-	commandBuffers.resize(swapChainFramebuffers.size());
+	commandBuffers.resize(setCount);
 
 	//Set up command buffer info
 	VkCommandBufferAllocateInfo allocInfo = {};
@@ -1232,243 +1684,602 @@ void VulkanApp::createCommandBuffers() {
 		throw std::runtime_error("failed to allocate command buffers!");
 	}
 
-	//For each command buffer set up info and bind the required data
+	//For each command buffer record every pass with the draws inline
 	for (size_t i = 0; i < commandBuffers.size(); i++) {
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		uint32_t frame = static_cast<uint32_t>(i / swapChainFramebuffers.size());
+		size_t image = i % swapChainFramebuffers.size();
 
-		if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-			throw std::runtime_error("failed to begin recording command buffer!");
-		}
+		recordCommandBuffer(commandBuffers[i], static_cast<uint32_t>(i), frame, image);
+	}
+}
 
+VkCommandBuffer VulkanApp::recordFrame(uint32_t frame, size_t image, uint32_t set) {
 
-		std::array<VkClearValue, 2> clearValues = {};
-		clearValues[0].color = { 0.2f, 0.2f, 0.2f, 1.0f };//Set clear colour
-		clearValues[1].depthStencil = { 1.0f, 0 };  
+	//This frame's fence has signaled, so everything allocated from its pools can be recorded again
+	commandRecorder.ResetFrame(frame);
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderPass; //Pass renderpass
-		renderPassInfo.framebuffer = swapChainFramebuffers[i]; //Pass frame buffer
-		renderPassInfo.renderArea.offset = { 0, 0 }; //No offset
-		renderPassInfo.renderArea.extent = swapChainExtent; //Set resolution
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size()); //Clear value to 1
-		renderPassInfo.pClearValues = clearValues.data(); //Pass in clear colour
+	//Each worker records a slice of the objects into one secondary buffer per pass
+	uint32_t threads = commandRecorder.ThreadCount();
+	std::vector<VkCommandBuffer> shadowDraws(threads);
+	std::vector<VkCommandBuffer> gbufferDraws(settings.depthPrePass ? 2 * threads : threads);
+	commandRecorder.Run([&](uint32_t thread) {
+		size_t first = m_Objects.size() * thread / threads;
+		size_t last = m_Objects.size() * (thread + 1) / threads;
 
+		shadowDraws[thread] = commandRecorder.BeginSecondary(frame, thread, 0, offscreenPass.renderPass, offscreenPass.frameBuffer);
+		recordShadowDraws(shadowDraws[thread], frame, first, last);
+		if (vkEndCommandBuffer(shadowDraws[thread]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
 
+		//Every worker's pre-pass buffer is executed before any GBuffer buffer, so all the depth is in first
+		size_t gbufferIndex = thread;
+		if (settings.depthPrePass)
+		{
+			gbufferDraws[thread] = commandRecorder.BeginSecondary(frame, thread, 2, offScreenFrameBuf.renderPass, offScreenFrameBuf.frameBuffer);
+			recordDepthPrePassDraws(gbufferDraws[thread], frame, first, last);
+			if (vkEndCommandBuffer(gbufferDraws[thread]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to record secondary command buffer!");
+			}
+			gbufferIndex = threads + thread;
+		}
 
+		gbufferDraws[gbufferIndex] = commandRecorder.BeginSecondary(frame, thread, 1, offScreenFrameBuf.renderPass, offScreenFrameBuf.frameBuffer);
+		recordGBufferDraws(gbufferDraws[gbufferIndex], frame, first, last);
+		if (vkEndCommandBuffer(gbufferDraws[gbufferIndex]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
+	});
 
-		//Begin render pass so we can bind
-		
+	//The primary begins the passes and executes the workers' buffers inside them
+	VkCommandBuffer commandBuffer = commandRecorder.Primary(frame);
+	recordCommandBuffer(commandBuffer, set, frame, image, &shadowDraws, &gbufferDraws);
+	return commandBuffer;
+}
 
+void VulkanApp::recordShadowDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t first, size_t last) {
 
-		
+	VkViewport viewportoff = {};
+	viewportoff.x = 0.0f; //No offset
+	viewportoff.y = 0.0f;//No offset
+	//Resolution
+	viewportoff.width = 2048;
+	viewportoff.height = 2048;
+	//Depth buffer range
+	viewportoff.minDepth = 0.0f;
+	viewportoff.maxDepth = 1.0f;
+
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewportoff);
+
+	VkRect2D scissor{};
+	scissor.extent.width = 2048;
+	scissor.extent.height = 2048;
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipeline);
+	vkCmdSetDepthBias(
+		commandBuffer,
+		1.25f,
+		0.0f,
+		1.75f);
+
+	//Secondary buffers inherit no bound sets, so the frame block is bound in every buffer
+	bindFrameSet(commandBuffer, frame, scenePipelineLayout);
+	geometryArena.CmdBind(commandBuffer);
+
+	//Pre-recorded, the culling pre-pass has written every object's command, and the shadow pass needs no textures so one call draws them all
+	if (!settings.recordEachFrame)
+	{
+		uint32_t count = static_cast<uint32_t>(m_Objects.size());
+		if (multiDrawIndirect)
+			vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, drawCommandOffset(frame, true, 0), count, sizeof(VkDrawIndexedIndirectCommand));
+		else
+			for (uint32_t slot = 0; slot < count; slot++)
+				vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, drawCommandOffset(frame, true, slot), 1, sizeof(VkDrawIndexedIndirectCommand));
+		return;
+	}
 
-		//Set up and bind in vertex infomation
-		std::vector<VkBuffer> vertexBuffers;
-		for (unsigned int v = 0; v < m_Objects.size(); v++)
-		{
-			vertexBuffers.push_back(m_Objects[v]->GetVertexBuffer());
-		}
+	for (size_t j = first; j < last; j++)
+	{
+		//Recorded this frame, so objects outside the light frustum are left out
+		if (!m_Objects[j]->CastsShadow() || !shadowVisible[j])
+			continue;
 
-		//VkBuffer vertexBuffers[] = { m_Objects[j]->GetVertexBuffer() };
-		VkDeviceSize offsets[] = { 0 };
-		
-		clearValues[0].depthStencil = { 1.0f, 0 };
+		//The instance index picks the object's data
+		const MeshRange& mesh = m_Objects[j]->GetMesh();
+		vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset, static_cast<uint32_t>(j));
+	}
+}
 
-		VkRenderPassBeginInfo renderPassBeginInfo{};
-		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBeginInfo.renderPass = offscreenPass.renderPass;
-		renderPassBeginInfo.framebuffer = offscreenPass.frameBuffer;
-		renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
-		renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
-		renderPassBeginInfo.clearValueCount = 1;
-		renderPassBeginInfo.pClearValues = clearValues.data();
+void VulkanApp::recordGBufferDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t first, size_t last) {
 
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	//Set up dynamic viewport
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-		for (unsigned int j = 0; j < m_Objects.size(); j++)
-		{
-			//Get depth texture
-			if(j < 2 || j > 2)
-			{
-				
-				VkViewport viewportoff = {};
-				viewportoff.x = 0.0f; //No offset
-				viewportoff.y = 0.0f;//No offset
-				//Resolution
-				viewportoff.width = 2048;
-				viewportoff.height = 2048;
-				//Depth buffer range
-				viewportoff.minDepth = 0.0f;
-				viewportoff.maxDepth = 1.0f;
-
-				vkCmdSetViewport(commandBuffers[i], 0, 1, &viewportoff);
-
-				VkRect2D scissor{};
-				scissor.extent.width = 2048;
-				scissor.extent.height = 2048;
-				scissor.offset.x = 0;
-				scissor.offset.y = 0;
-				vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
-
-				vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipeline);
-				vkCmdSetDepthBias(
-					commandBuffers[i],
-					1.25f,
-					0.0f,
-					1.75f);
-
-
-				vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, offscreenPipelineLayout, 0, 1, &offscreenDescSets[j], 0, NULL);
-
-				vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, &m_Objects[j]->GetVertexBuffer(), offsets);
-				vkCmdBindIndexBuffer(commandBuffers[i], m_Objects[j]->GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
-				vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(m_Objects[j]->GetIndices().size()), 1, 0, 0, 0);
+	VkRect2D scissor{};
+	scissor.extent.width = swapChainExtent.width;
+	scissor.extent.height = swapChainExtent.height;
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-				
-			}
+	//Bind the graphics pipeline
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GBufferGraphicsPipeline);
+
+	//Secondary buffers inherit no bound sets, so the frame block is bound in every buffer
+	bindFrameSet(commandBuffer, frame, scenePipelineLayout);
+	geometryArena.CmdBind(commandBuffer);
+
+	//Pre-recorded, the culling pre-pass has written every object's command, one call per material
+	if (!settings.recordEachFrame)
+	{
+		for (const DrawBatch& batch : drawBatches)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scenePipelineLayout, 0, 1, &batch.material->descriptorSet, 0, nullptr);
+			if (multiDrawIndirect)
+				vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, drawCommandOffset(frame, false, batch.firstSlot), batch.count, sizeof(VkDrawIndexedIndirectCommand));
+			else
+				for (uint32_t slot = batch.firstSlot; slot < batch.firstSlot + batch.count; slot++)
+					vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, drawCommandOffset(frame, false, slot), 1, sizeof(VkDrawIndexedIndirectCommand));
 		}
-		vkCmdEndRenderPass(commandBuffers[i]);
-		std::array<VkClearValue, 4> clearValuesG;
-		clearValuesG[0].color = clearValuesG[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValuesG[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValuesG[3].depthStencil = { 1.0f, 0 };
-		renderPassBeginInfo = {};
-		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBeginInfo.renderPass = offScreenFrameBuf.renderPass;
-		renderPassBeginInfo.framebuffer = offScreenFrameBuf.frameBuffer;
-		renderPassBeginInfo.renderArea.extent = swapChainExtent;
-		renderPassBeginInfo.clearValueCount = 4;
-		renderPassBeginInfo.pClearValues = clearValuesG.data();
+		return;
+	}
 
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		for (unsigned int j = 0; j < m_Objects.size(); j++)
+	Material* boundMaterial = nullptr;
+	for (size_t j = first; j < last; j++)
+	{
+		//Recorded this frame, so objects outside the camera frustum are left out
+		if (!cameraVisible[j])
+			continue;
+
+		////Set the descipter to graphics, only when the material changes
+		if (m_Objects[j]->GetMaterial() != boundMaterial)
 		{
-			//Draw Scene
-			{
-				
-				vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, &m_Objects[j]->GetVertexBuffer(), offsets);
-				unsigned int index = m_Objects.size() * i + j;
-				std::cout << index << std::endl;
+			boundMaterial = m_Objects[j]->GetMaterial();
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scenePipelineLayout, 0, 1, &boundMaterial->descriptorSet, 0, nullptr);
+		}
 
-				//Set up dynamic viewport
-				vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
+		////Call the draw command, the instance index picks the object's data
+		const MeshRange& mesh = m_Objects[j]->GetMesh();
+		vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset, static_cast<uint32_t>(j));
+	}
+}
 
-				VkRect2D scissor{};
-				scissor.extent.width = swapChainExtent.width;
-				scissor.extent.height = swapChainExtent.height;
-				scissor.offset.x = 0;
-				scissor.offset.y = 0;
-				vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
+void VulkanApp::recordDepthPrePassDraws(VkCommandBuffer commandBuffer, uint32_t frame, size_t first, size_t last) {
 
-				//Bind index buffer
-				vkCmdBindIndexBuffer(commandBuffers[i], m_Objects[j]->GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
+	VkRect2D scissor{};
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-				//Bind the graphics pipeline
-				vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, GBufferGraphicsPipeline);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPrePassPipeline);
 
-				////Set the descipter to graphics
-				vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[index], 0, nullptr);
+	//Secondary buffers inherit no bound sets, so the frame block is bound in every buffer
+	bindFrameSet(commandBuffer, frame, scenePipelineLayout);
+	geometryArena.CmdBind(commandBuffer);
 
-				////Call the draw command
-				vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(m_Objects[j]->GetIndices().size()), 1, 0, 0, 0);
-				//vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
-				
-			}
+	//Pre-recorded, the same commands the GBuffer draws with, no textures are read so one call draws them all
+	if (!settings.recordEachFrame)
+	{
+		uint32_t count = static_cast<uint32_t>(m_Objects.size());
+		if (multiDrawIndirect)
+			vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, drawCommandOffset(frame, false, 0), count, sizeof(VkDrawIndexedIndirectCommand));
+		else
+			for (uint32_t slot = 0; slot < count; slot++)
+				vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, drawCommandOffset(frame, false, slot), 1, sizeof(VkDrawIndexedIndirectCommand));
+		return;
+	}
 
-		}
-		vkCmdEndRenderPass(commandBuffers[i]);
-
-		std::array<VkClearValue, 1> clearValuesD;
-		clearValuesD[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		//clearValuesD[1].depthStencil = { 1.0f, 0 };
-		renderPassBeginInfo = {};
-		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBeginInfo.renderPass = subsurfaceManager.SSRenderPass;
-		renderPassBeginInfo.framebuffer = subsurfaceManager.SSFrameBuffer;
-		renderPassBeginInfo.renderArea.extent = swapChainExtent;
-		renderPassBeginInfo.clearValueCount = 1;
-		renderPassBeginInfo.pClearValues = clearValuesD.data();
+	for (size_t j = first; j < last; j++)
+	{
+		if (!cameraVisible[j])
+			continue;
 
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		{
-			vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, &m_Objects[0]->GetVertexBuffer(), offsets);
+		const MeshRange& mesh = m_Objects[j]->GetMesh();
+		vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset, static_cast<uint32_t>(j));
+	}
+}
 
-			//Set up dynamic viewport
-			vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
+void VulkanApp::bindFrameSet(VkCommandBuffer commandBuffer, uint32_t frame, VkPipelineLayout layout, VkPipelineBindPoint bindPoint) {
 
-			VkRect2D scissor{};
-			scissor.extent.width = swapChainExtent.width;
-			scissor.extent.height = swapChainExtent.height;
-			scissor.offset.x = 0;
-			scissor.offset.y = 0;
-			vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
+	//Set 0 differs between the scene, screen space and culling layouts, so set 1 is bound again whenever the layout changes
+	std::array<uint32_t, 3> frameOffsets = { uniformRing.Offset(frame, frameBlock), uniformRing.Offset(frame, kernelBlock), uniformRing.Offset(frame, objectBlock) };
+	vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, 1, 1, &frameSet, static_cast<uint32_t>(frameOffsets.size()), frameOffsets.data());
+}
 
-			//Bind index buffer
-			vkCmdBindIndexBuffer(commandBuffers[i], m_Objects[0]->GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+void VulkanApp::recordCullPass(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame) {
 
+	//Timed even when recording each frame, every pass of a query set must be written
+	gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_CULL);
+	if (!settings.recordEachFrame)
+	{
+		//One thread per object, each writes its GBuffer and shadow command
+		uint32_t objectCount = static_cast<uint32_t>(m_Objects.size());
+		uint32_t drawOffset = static_cast<uint32_t>(frame * drawRegionSize);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullSet, 1, &drawOffset);
+		bindFrameSet(commandBuffer, frame, cullPipelineLayout, VK_PIPELINE_BIND_POINT_COMPUTE);
+		vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &objectCount);
+		vkCmdDispatch(commandBuffer, (objectCount + 63) / 64, 1, 1);
+
+		//The draw commands must be written before the passes read them
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = drawCommandBuffer;
+		barrier.offset = frame * drawRegionSize;
+		barrier.size = drawRegionSize;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+	}
+	gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_CULL);
+}
 
-			//Bind the graphics pipeline
-			vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+void VulkanApp::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame, size_t image, const std::vector<VkCommandBuffer>* shadowDraws, const std::vector<VkCommandBuffer>* gbufferDraws) {
+
+	//Draws are either recorded inline here or executed from the secondary buffers
+	bool secondary = shadowDraws != nullptr;
+	VkSubpassContents drawContents = secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = secondary ? VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT : VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording command buffer!");
+	}
+	gpuProfiler.CmdReset(commandBuffer, set);
+
+	recordCullPass(commandBuffer, set, frame);
+
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassBeginInfo{};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = offscreenPass.renderPass;
+	renderPassBeginInfo.framebuffer = offscreenPass.frameBuffer;
+	renderPassBeginInfo.renderArea.extent.width = offscreenPass.width;
+	renderPassBeginInfo.renderArea.extent.height = offscreenPass.height;
+	renderPassBeginInfo.clearValueCount = 1;
+	renderPassBeginInfo.pClearValues = clearValues.data();
+
+	gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_SHADOW);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, drawContents);
+	if (secondary)
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(shadowDraws->size()), shadowDraws->data());
+	else
+		recordShadowDraws(commandBuffer, frame, 0, m_Objects.size());
+	vkCmdEndRenderPass(commandBuffer);
+	gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_SHADOW);
+	//Indexed by attachment, the resolves in 4 to 7 (and the lit colour in 9) are not cleared. The depth copy clears to 0, which the subsurface passes skip
+	std::array<VkClearValue, 9> clearValuesG = {};
+	clearValuesG[0].color = clearValuesG[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+	clearValuesG[1].color.uint32[0] = clearValuesG[1].color.uint32[1] = clearValuesG[1].color.uint32[2] = clearValuesG[1].color.uint32[3] = 0; //Integer targets, no flags is unlit
+	clearValuesG[3].depthStencil = { 1.0f, 0 };
+	clearValuesG[8].color.uint32[0] = 0;
+	renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = offScreenFrameBuf.renderPass;
+	renderPassBeginInfo.framebuffer = offScreenFrameBuf.frameBuffer;
+	renderPassBeginInfo.renderArea.extent = swapChainExtent;
+	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValuesG.size());
+	renderPassBeginInfo.pClearValues = clearValuesG.data();
+
+	gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_GBUFFER);
+	gpuProfiler.CmdBeginFragments(commandBuffer, set);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, drawContents);
+	if (secondary)
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(gbufferDraws->size()), gbufferDraws->data());
+	else
+	{
+		if (settings.depthPrePass)
+			recordDepthPrePassDraws(commandBuffer, frame, 0, m_Objects.size());
+		recordGBufferDraws(commandBuffer, frame, 0, m_Objects.size());
+	}
+	//The lighting subpass is timed as its own pass, the fragment count then includes its one invocation per pixel
+	//The split is written once the inline subpass has begun, a subpass recorded from secondaries only takes vkCmdExecuteCommands
+	//so the GBuffer time includes the subpass transition
+	if (settings.gbufferSubpasses)
+	{
+		vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+		gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_GBUFFER);
+		gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_LIGHTING);
+		recordLightingDraw(commandBuffer, frame);
+		vkCmdEndRenderPass(commandBuffer);
+		gpuProfiler.CmdEndFragments(commandBuffer, set);
+		gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_LIGHTING);
+	}
+	else
+	{
+		vkCmdEndRenderPass(commandBuffer);
+		gpuProfiler.CmdEndFragments(commandBuffer, set);
+		gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_GBUFFER);
 
-			////Set the descipter to graphics
-			vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &finalRSet, 0, nullptr);
+		recordLightingPass(commandBuffer, set, frame);
+	}
 
-			////Call the draw command
-			vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(m_Objects[0]->GetIndices().size()), 1, 0, 0, 0);
+	//Subsurface scattering blur, ending in the swap chain image
+	if (subsurfaceManager.burley)
+		recordBurleySubsurface(commandBuffer, set, frame, image);
+	else if (settings.computeSubsurface)
+		recordComputeSubsurface(commandBuffer, set, frame, image);
+	else
+		recordRasterSubsurface(commandBuffer, set, frame, image);
 
-		}
-		vkCmdEndRenderPass(commandBuffers[i]);
 
-		std::array<VkClearValue, 2> clearValuesS;
-		clearValuesS[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-		clearValuesS[1].depthStencil = { 1.0f, 0 };
+	//End pass
+	//vkCmdEndRenderPass(commandBuffer);
+	
+	//Check the command has ended and error check
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record command buffer!");
+	}
+}
+
+void VulkanApp::recordRasterSubsurface(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame, size_t image) {
+
+	//The screen space passes use their own set 0 layout
+	bindFrameSet(commandBuffer, frame, pipelineLayout);
+
+	//Both blur directions run at the reduced size when scaled, then one more pass upsamples into the swap chain image
+	const bool scaled = subsurfaceManager.resolutionScale > 1;
+	VkExtent2D blurExtent = scaled ? subsurfaceManager.scaledExtent : swapChainExtent;
+
+	VkViewport blurViewport = viewport;
+	blurViewport.width = (float)blurExtent.width;
+	blurViewport.height = (float)blurExtent.height;
+
+	VkRect2D blurScissor{};
+	blurScissor.extent = blurExtent;
+
+	std::array<VkClearValue, 2> clearValuesD;
+	clearValuesD[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+	clearValuesD[1].depthStencil = { 1.0f, 0 };
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = subsurfaceManager.SSRenderPass;
+	renderPassBeginInfo.framebuffer = scaled ? subsurfaceManager.scaledFrameBuffers[0] : subsurfaceManager.SSFrameBuffer;
+	renderPassBeginInfo.renderArea.extent = blurExtent;
+	renderPassBeginInfo.clearValueCount = 2;
+	renderPassBeginInfo.pClearValues = clearValuesD.data();
+
+	gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_SSS_HORIZONTAL);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	{
+		//Set up dynamic viewport
+		vkCmdSetViewport(commandBuffer, 0, 1, &blurViewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &blurScissor);
+
+		////Set the descipter to graphics
+		uint32_t dynamicOffset = uniformRing.Offset(frame, GBUniformBlock);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &finalRSet, 1, &dynamicOffset);
+
+		//Copy the pixels without subsurface scattering and mark them in the stencil
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, subsurfaceManager.maskPipeline);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+		//Blur the rest, the stencil test rejects the marked pixels before the fragment shader runs
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+	}
+	vkCmdEndRenderPass(commandBuffer);
+	gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_SSS_HORIZONTAL);
+
+	//The temporal vertical pass writes this frame's history image, which is then copied into the swap chain image
+	const bool temporal = subsurfaceManager.temporalPhases > 1;
+
+	std::array<VkClearValue, 2> clearValuesS;
+	clearValuesS[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+	clearValuesS[1].depthStencil = { 1.0f, 0 };
+	if (temporal) {
+		renderPassBeginInfo.renderPass = subsurfaceManager.historyRenderPass;
+		renderPassBeginInfo.framebuffer = subsurfaceManager.historyFrameBuffers[frame];
+	}
+	else {
+		renderPassBeginInfo.renderPass = scaled ? subsurfaceManager.SSLoadRenderPass : renderPass;
+		renderPassBeginInfo.framebuffer = scaled ? subsurfaceManager.scaledFrameBuffers[1] : swapChainFramebuffers[image];
+	}
+	renderPassBeginInfo.clearValueCount = 2;
+	renderPassBeginInfo.pClearValues = clearValuesS.data();
+	gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_SSS_VERTICAL);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	{
+		//Set up dynamic viewport
+		vkCmdSetViewport(commandBuffer, 0, 1, &blurViewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &blurScissor);
+
+		////Set the descipter to graphics
+		VkDescriptorSet verticalSet = temporal ? subsurfaceManager.temporalSets[frame] : scaled ? subsurfaceManager.scaledVerticalSet : subsurfaceManager.finalSSet;
+		uint32_t dynamicOffset = uniformRing.Offset(frame, subsurfaceManager.SSUniformBlock);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &verticalSet, 1, &dynamicOffset);
+
+		//Same split as the horizontal pass, using the stencil it wrote
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, temporal ? subsurfaceManager.historyCopyPipeline : subsurfaceManager.copyPipeline);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, temporal ? subsurfaceManager.temporalPipeline : subsurfaceManager.SSGraphicsPipeline);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+	}
+	vkCmdEndRenderPass(commandBuffer);
+
+	//The vertical time includes the upsample or history copy
+	if (scaled || temporal)
+	{
 		renderPassBeginInfo.renderPass = renderPass;
-		renderPassBeginInfo.framebuffer = swapChainFramebuffers[i];
-		renderPassBeginInfo.clearValueCount = 2;
-		renderPassBeginInfo.pClearValues = clearValuesS.data();
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		renderPassBeginInfo.framebuffer = swapChainFramebuffers[image];
+		renderPassBeginInfo.renderArea.extent = swapChainExtent;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 		{
-			vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, &m_Objects[0]->GetVertexBuffer(), offsets);
-
-			//Set up dynamic viewport
-			vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
 			VkRect2D scissor{};
-			scissor.extent.width = swapChainExtent.width;
-			scissor.extent.height = swapChainExtent.height;
-			scissor.offset.x = 0;
-			scissor.offset.y = 0;
-			vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
+			scissor.extent = swapChainExtent;
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, temporal ? subsurfaceManager.compositePipeline : subsurfaceManager.upsamplePipeline);
+
+			VkDescriptorSet resultSet = temporal ? subsurfaceManager.historyCompositeSets[frame] : subsurfaceManager.upsampleSet;
+			uint32_t dynamicOffset = uniformRing.Offset(frame, subsurfaceManager.SSUniformBlock);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &resultSet, 1, &dynamicOffset);
+
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		}
+		vkCmdEndRenderPass(commandBuffer);
+	}
+	gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_SSS_VERTICAL);
+}
 
-			//Bind index buffer
-			vkCmdBindIndexBuffer(commandBuffers[i], m_Objects[0]->GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+void VulkanApp::recordComputeSubsurface(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame, size_t image) {
 
+	subsurfaceManager.CmdPrepareCompute(commandBuffer);
 
-			//Bind the graphics pipeline
-			vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, subsurfaceManager.SSGraphicsPipeline);
+	//The horizontal time includes finding the tiles to blur
+	gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_SSS_HORIZONTAL);
+	if (subsurfaceManager.tiled)
+		subsurfaceManager.CmdClassifyTiles(commandBuffer);
 
-			////Set the descipter to graphics
-			vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &subsurfaceManager.finalSSet, 0, nullptr);
+	//The kernel comes from the frame set
+	bindFrameSet(commandBuffer, frame, subsurfaceManager.computePipelineLayout, VK_PIPELINE_BIND_POINT_COMPUTE);
 
-			////Call the draw command
-			vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(m_Objects[0]->GetIndices().size()), 1, 0, 0, 0);
+	subsurfaceManager.CmdDispatchBlur(commandBuffer, false);
+	gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_SSS_HORIZONTAL);
 
-		}
-		vkCmdEndRenderPass(commandBuffers[i]);
+	//The vertical time includes copying the result into the swap chain image
+	gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_SSS_VERTICAL);
+	subsurfaceManager.CmdDispatchBlur(commandBuffer, true);
 
+	std::array<VkClearValue, 2> clearValues;
+	clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = renderPass;
+	renderPassBeginInfo.framebuffer = swapChainFramebuffers[image];
+	renderPassBeginInfo.renderArea.extent = swapChainExtent;
+	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassBeginInfo.pClearValues = clearValues.data();
 
-		//End pass
-		//vkCmdEndRenderPass(commandBuffers[i]);
-		
-		//Check the command has ended and error check
-		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to record command buffer!");
-		}
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	{
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor{};
+		scissor.extent = swapChainExtent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, subsurfaceManager.compositePipeline);
+		bindFrameSet(commandBuffer, frame, pipelineLayout);
+
+		uint32_t dynamicOffset = uniformRing.Offset(frame, subsurfaceManager.SSUniformBlock);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &subsurfaceManager.compositeSet, 1, &dynamicOffset);
+
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 	}
+	vkCmdEndRenderPass(commandBuffer);
+	gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_SSS_VERTICAL);
+}
+
+void VulkanApp::recordLightingPass(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame) {
+
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = lightingPass.renderPass;
+	renderPassBeginInfo.framebuffer = lightingPass.frameBuffer;
+	renderPassBeginInfo.renderArea.extent = swapChainExtent;
+
+	gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_LIGHTING);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	recordLightingDraw(commandBuffer, frame);
+	vkCmdEndRenderPass(commandBuffer);
+	gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_LIGHTING);
+}
+
+void VulkanApp::recordLightingDraw(VkCommandBuffer commandBuffer, uint32_t frame) {
+
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	//Frame set for the camera and light, set 0 for the resolved GBuffer and shadow map
+	VkPipelineLayout layout = settings.gbufferSubpasses ? lightingPass.pipelineLayout : pipelineLayout;
+	bindFrameSet(commandBuffer, frame, layout);
+	uint32_t dynamicOffset = uniformRing.Offset(frame, GBUniformBlock);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &lightingPass.descriptorSet, 1, &dynamicOffset);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingPass.pipeline);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void VulkanApp::recordBurleySubsurface(VkCommandBuffer commandBuffer, uint32_t set, uint32_t frame, size_t image) {
+
+	std::array<VkClearValue, 2> clearValues;
+	clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = renderPass;
+	renderPassBeginInfo.framebuffer = swapChainFramebuffers[image];
+	renderPassBeginInfo.renderArea.extent = swapChainExtent;
+	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassBeginInfo.pClearValues = clearValues.data();
+
+	//The one pass is timed as the horizontal pass, so the SSS total compares directly with the separable blur's two
+	gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_SSS_HORIZONTAL);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	{
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor{};
+		scissor.extent = swapChainExtent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		//Frame set for the kernel and frame index, the horizontal pass's set for the GBuffer
+		bindFrameSet(commandBuffer, frame, pipelineLayout);
+		uint32_t dynamicOffset = uniformRing.Offset(frame, GBUniformBlock);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &finalRSet, 1, &dynamicOffset);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, subsurfaceManager.burleyPipeline);
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	}
+	vkCmdEndRenderPass(commandBuffer);
+	gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_SSS_HORIZONTAL);
+
+	//Nothing to time, still written so the query set is complete
+	gpuProfiler.CmdBegin(commandBuffer, set, GPU_PASS_SSS_VERTICAL);
+	gpuProfiler.CmdEnd(commandBuffer, set, GPU_PASS_SSS_VERTICAL);
+}
+
+void VulkanApp::switchSubsurfaceMode() {
+
+	//Every frame in flight uses the recorded command buffers
+	vkDeviceWaitIdle(device);
+
+	//Report the blur being left, then start the statistics again for the other one
+	for (size_t i = 0; i < profiledSets.size(); i++)
+		gpuProfiler.Collect(profiledSets[i]);
+	gpuProfiler.Report(std::cout);
+	gpuProfiler.ClearStatistics();
+
+	subsurfaceManager.burley = !subsurfaceManager.burley;
+	subsurfaceManager.historyAge = 0; //The temporal history is not written by the Burley blur
+	std::cout << "Subsurface scattering: " << (subsurfaceManager.burley ? "Burley" : "separable") << std::endl;
+
+	//Recorded again with the other blur, or left to drawFrame when recording each frame
+	if (!commandBuffers.empty())
+		vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	commandBuffers.clear();
+	gpuProfiler.DestroyQueries();
+	createCommandBuffers();
 }
 
 void VulkanApp::createSyncObjects()
@@ -1524,16 +2335,20 @@ void VulkanApp::recreateSwapChain() {
 	createImageViews();
 	createRenderPass();
 	createColorResources();
+	createDepthResources();
 	CreateSSFrameBuffer();
 	prepareGOffscreenFramebuffer();
+	prepareLightingFramebuffer();
 	createGraphicsPipeline();
 	
-	createDepthResources();
 	createFramebuffers();
 	
 	UpdateGBufferSets();
 
 	createCommandBuffers();
+
+	//Screen quad size has changed
+	screenPassDirtyFrames = MAX_FRAMES_IN_FLIGHT;
 }
 
 void VulkanApp::cleanupSwapChain() {
@@ -1548,15 +2363,23 @@ void VulkanApp::cleanupSwapChain() {
 	for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 		vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
 	}
-	//free memory from command buffers
-	vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	//free memory from command buffers and the timestamp queries they write
+	if (!commandBuffers.empty())
+		vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	commandBuffers.clear();
+	gpuProfiler.DestroyQueries();
 
 	//Destroy graphics pipline and layout
 	vkDestroyPipeline(device, GBufferGraphicsPipeline, nullptr);
+	vkDestroyPipeline(device, depthPrePassPipeline, nullptr);
+	depthPrePassPipeline = VK_NULL_HANDLE;
+	vkDestroyPipeline(device, lightingPass.pipeline, nullptr);
+	vkDestroyPipelineLayout(device, lightingPass.pipelineLayout, nullptr);
+	lightingPass.pipelineLayout = VK_NULL_HANDLE;
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
 	vkDestroyPipeline(device, offscreenPipeline, nullptr);
-	vkDestroyPipelineLayout(device, offscreenPipelineLayout, nullptr);
+	vkDestroyPipelineLayout(device, scenePipelineLayout, nullptr);
 	vkDestroyRenderPass(device, renderPass, nullptr); //Clean up render pass data
 
 	//Clean up SSS
@@ -1566,8 +2389,16 @@ void VulkanApp::cleanupSwapChain() {
 		vkDestroyImageView(device, swapChainImageViews[i], nullptr);
 	}
 	
-	//Destroy the actual swapchain object
-	vkDestroySwapchainKHR(device, swapChain, nullptr);
+	//Destroy the actual swapchain object, or the offscreen targets that replace it
+	if (settings.headless) {
+		for (size_t i = 0; i < swapChainImages.size(); i++) {
+			vkDestroyImage(device, swapChainImages[i], nullptr);
+			vkFreeMemory(device, headlessImageMemory[i], nullptr);
+		}
+	}
+	else {
+		vkDestroySwapchainKHR(device, swapChain, nullptr);
+	}
 }
 
 
@@ -1578,7 +2409,7 @@ void VulkanApp::createDescriptorSetLayout()
 	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
 	uboLayoutBinding.binding = 0;
 	uboLayoutBinding.descriptorCount = 1;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC; //Block picked by a dynamic offset into the uniform ring
 	uboLayoutBinding.pImmutableSamplers = nullptr;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
@@ -1609,9 +2440,12 @@ void VulkanApp::createDescriptorSetLayout()
 	specSamplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	specSamplerLayoutBinding.pImmutableSamplers = nullptr;
 	specSamplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-	
 
-	std::array<VkDescriptorSetLayoutBinding, 5> bindings = { uboLayoutBinding, samplerLayoutBinding, depthSamplerLayoutBinding, normalSamplerLayoutBinding, specSamplerLayoutBinding };// guboLayoutBinding
+	//Screen space passes only, the GBuffer motion read by the temporal subsurface pass
+	VkDescriptorSetLayoutBinding motionSamplerLayoutBinding = specSamplerLayoutBinding;
+	motionSamplerLayoutBinding.binding = 5;
+
+	std::array<VkDescriptorSetLayoutBinding, 6> bindings = { uboLayoutBinding, samplerLayoutBinding, depthSamplerLayoutBinding, normalSamplerLayoutBinding, specSamplerLayoutBinding, motionSamplerLayoutBinding };// guboLayoutBinding
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -1622,169 +2456,340 @@ void VulkanApp::createDescriptorSetLayout()
 		throw std::runtime_error("failed to create descriptor set layout!");
 	}
 
-}
+	//Scene set 0, only the material textures, the object's data comes from set 1
+	std::array<VkDescriptorSetLayoutBinding, 4> materialBindings = { samplerLayoutBinding, depthSamplerLayoutBinding, normalSamplerLayoutBinding, specSamplerLayoutBinding };
 
-void VulkanApp::createUniformBuffers()
-{
-	//Get size of buffer
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	layoutInfo.bindingCount = static_cast<uint32_t>(materialBindings.size());
+	layoutInfo.pBindings = materialBindings.data();
 
-	unsigned int size = 0;
-	for (unsigned int i = 0; i < m_Objects.size(); i++)
-	{
-		size += swapChainImages.size();
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &materialSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create material descriptor set layout!");
 	}
 
-	//Allocate memory
-	uniformBuffers.resize(size);
-	uniformBuffersMemory.resize(size);
+	//Lighting subpass set 0, laid out like the screen space sets but reading the GBuffer as input attachments
+	if (settings.gbufferSubpasses)
+	{
+		VkDescriptorSetLayoutBinding inputLayoutBinding = samplerLayoutBinding;
+		inputLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		std::array<VkDescriptorSetLayoutBinding, 6> lightingBindings = { uboLayoutBinding, inputLayoutBinding, inputLayoutBinding, normalSamplerLayoutBinding, inputLayoutBinding, motionSamplerLayoutBinding };
+		lightingBindings[2].binding = 2;
+		lightingBindings[4].binding = 4;
 
-	//Create a uniform buffer for each of the swap chain images
-	for (size_t i = 0; i < size; i++) {
-		m_Engine->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
+		layoutInfo.bindingCount = static_cast<uint32_t>(lightingBindings.size());
+		layoutInfo.pBindings = lightingBindings.data();
+
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &lightingPass.setLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create lighting descriptor set layout!");
+		}
 	}
-	offscreenUniforms.resize(m_Objects.size());
-	offscreenMemorys.resize(m_Objects.size());
-	for (size_t i = 0; i < m_Objects.size(); i++) {
-		m_Engine->createBuffer(sizeof(OffScreenUniformBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, offscreenUniforms[i], offscreenMemorys[i]);
+
+	//Set 1, blocks shared by every draw in the frame
+	VkDescriptorSetLayoutBinding frameLayoutBinding = {};
+	frameLayoutBinding.binding = 0;
+	frameLayoutBinding.descriptorCount = 1;
+	frameLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	frameLayoutBinding.pImmutableSamplers = nullptr;
+	frameLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT; //Culling reads the frustum planes, the temporal blur the reprojection
+
+	VkDescriptorSetLayoutBinding kernelLayoutBinding = {};
+	kernelLayoutBinding.binding = 1;
+	kernelLayoutBinding.descriptorCount = 1;
+	kernelLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	kernelLayoutBinding.pImmutableSamplers = nullptr;
+	kernelLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT; //Read by both blurs
+
+	//Every object's data in one array, indexed by the draw's instance index
+	VkDescriptorSetLayoutBinding objectLayoutBinding = {};
+	objectLayoutBinding.binding = 2;
+	objectLayoutBinding.descriptorCount = 1;
+	objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	objectLayoutBinding.pImmutableSamplers = nullptr;
+	objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+	std::array<VkDescriptorSetLayoutBinding, 3> frameBindings = { frameLayoutBinding, kernelLayoutBinding, objectLayoutBinding };
+
+	layoutInfo.bindingCount = static_cast<uint32_t>(frameBindings.size());
+	layoutInfo.pBindings = frameBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &frameSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create frame descriptor set layout!");
 	}
 
-	m_Engine->createBuffer(sizeof(GBufferUniformBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, GBUniform, GBUniformMemory);
-	m_Engine->createBuffer(sizeof(GBufferUniformBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, subsurfaceManager.SSUniform, subsurfaceManager.SSUniformMemory);
+	//Culling set 0, the draw commands it writes
+	VkDescriptorSetLayoutBinding drawLayoutBinding = {};
+	drawLayoutBinding.binding = 0;
+	drawLayoutBinding.descriptorCount = 1;
+	drawLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC; //Region picked by the frame
+	drawLayoutBinding.pImmutableSamplers = nullptr;
+	drawLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &drawLayoutBinding;
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling descriptor set layout!");
+	}
 }
 
-void VulkanApp::updateUniformBuffer(uint32_t currentImage, unsigned int objectIndex)
+void VulkanApp::createUniformBuffers()
 {
-	unsigned int index = m_Objects.size() * currentImage + objectIndex;
+	//Lay out every uniform block once, each frame in flight gets its own copy of the layout
+	uniformRing.SetAlignment(physicalDevice);
 
-	
-	//Time at start of frame
-	static auto startTime = std::chrono::high_resolution_clock::now();
+	frameBlock = uniformRing.Reserve(sizeof(FrameUniformBufferObject));
+	kernelBlock = uniformRing.Reserve(sizeof(KernelUniformBufferObject));
 
-	//Current time
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	//Delta Time
-	
-	
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
-	//std::cout << time - realTime << '\r' << std::endl;// std::flush;
-	timercount += time - realTime;
-	realTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	//One array for every object, read as a storage buffer
+	objectBlock = uniformRing.Reserve(m_Objects.size() * sizeof(ObjectData));
+	objectData.resize(m_Objects.size());
 
-	
+	GBUniformBlock = uniformRing.Reserve(sizeof(GBufferUniformBufferObject));
+	subsurfaceManager.SSUniformBlock = uniformRing.Reserve(sizeof(GBufferUniformBufferObject));
 
-	if (timercount >= 1)
-	{
-		timercount = 0;
-		std::cout << framecount << '\r' << std::endl;
-		framecount = 0;
-	}
+	uniformRing.Create(m_Engine, device, MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	//Nothing has been written yet, so every frame's copy of every block is out of date
+	objectDirtyFrames.assign(m_Objects.size(), MAX_FRAMES_IN_FLIGHT);
+	kernelDirtyFrames = MAX_FRAMES_IN_FLIGHT;
+	screenPassDirtyFrames = MAX_FRAMES_IN_FLIGHT;
+	uploadedKernelVersion = subsurfaceManager.kernelVersion;
+}
 
+void VulkanApp::updateFrameUniforms(uint32_t frame)
+{
+	//Time set by updateClock at the start of the frame
+	float time = realTime;
+
+	//Move the light, and the object that marks it
 	glm::vec3 lightPos = glm::vec3(-0.0f, 0.1f, -0.75f) *glm::mat3(glm::rotate(time * glm::radians(45.0f), glm::vec3(0, 1, 0)));
-	if (objectIndex == 2)
-	{
-		glm::vec3 newPos = lightPos;
-		glm::vec3 vDir = glm::normalize(-newPos);
-		newPos += vDir * glm::vec3(0.55f);
-		m_Objects[objectIndex]->SetPos(newPos);
-	}
+	glm::vec3 newPos = lightPos;
+	glm::vec3 vDir = glm::normalize(-newPos);
+	newPos += vDir * glm::vec3(0.55f);
+	m_Objects[2]->SetPos(newPos);
 
 	// Matrix from light's point of view
 	glm::mat4 depthProjectionMatrix = glm::perspective(glm::radians(45.0f), 1.0f / 1.0f, 0.01f, 150.0f);
 	depthProjectionMatrix[1][1] *= -1;
 	glm::mat4 depthViewMatrix = glm::lookAt(lightPos, glm::vec3(0.0f, 0.015f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 depthModelMatrix = glm::mat4(1); 
-	depthModelMatrix = glm::translate(glm::mat4(1.0f), m_Objects[objectIndex]->GetPos()) * glm::rotate(depthModelMatrix, time * glm::radians(m_Objects[objectIndex]->GetRot().y), glm::vec3(0, 1, 0)) * glm::scale(glm::mat4(1.0f), m_Objects[objectIndex]->GetScale());
-
-	//Set up the uniform model matrix (rotation and translation and scale)
-	UniformBufferObject ubo = {};
-	//glm::mat4 model = glm::translate(glm::mat4(1.0f), m_Objects[objectIndex]->GetPos()) * glm::rotate(ubo.model, time * glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(10.0f, 10.0f, 10.0f));
-	ubo.model = glm::mat4(1);
-	ubo.model = glm::translate(glm::mat4(1.0f), m_Objects[objectIndex]->GetPos()) * glm::rotate(ubo.model, time * glm::radians(m_Objects[objectIndex]->GetRot().y), glm::vec3(0, 1, 0)) * glm::scale(glm::mat4(1.0f), m_Objects[objectIndex]->GetScale());
-	
-	
+
+	FrameUniformBufferObject fubo = {};
 	//View matrix using look at
-	ubo.view = glm::lookAt(glm::vec3(0.0f, 0.1f, 0.55f), glm::vec3(0.0f, 0.015f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	fubo.view = glm::lookAt(glm::vec3(0.0f, 0.1f, 0.55f), glm::vec3(0.0f, 0.015f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 	//Projection / Perspective matrix
 	glm::mat4 proj = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.01f, 100.0f);
 	proj[1][1] *= -1;
-	ubo.proj = proj;
-	ubo.lightRot = glm::rotate(glm::mat4(1), time * glm::radians(45.0f), glm::vec3(0, 1, 0));
-	ubo.lightSpace = depthProjectionMatrix * depthViewMatrix * depthModelMatrix;
-	ubo.lightViewProj = depthProjectionMatrix * depthViewMatrix;
+	fubo.proj = proj;
+	fubo.lightRot = glm::rotate(glm::mat4(1), time * glm::radians(45.0f), glm::vec3(0, 1, 0));
+	fubo.lightViewProj = depthProjectionMatrix * depthViewMatrix;
+
+	//Last frame's camera, the subsurface history is reprojected with it
+	fubo.prevViewProj = cameraViewProj;
+	fubo.temporal = glm::vec4((float)(frameIndex % TEMPORAL_INDEX_PERIOD), (float)subsurfaceManager.temporalPhases, subsurfaceManager.historyBlend, subsurfaceManager.historyAge > 0 ? 1.0f : 0.0f);
+	if (subsurfaceManager.temporalPhases > 1 && !subsurfaceManager.burley)
+		subsurfaceManager.historyAge++;
+
+	//Kept for culling, on the CPU when recording each frame and by the culling pre-pass otherwise
+	cameraViewProj = fubo.proj * fubo.view;
+	shadowViewProj = fubo.lightViewProj;
+	fubo.invViewProj = glm::inverse(cameraViewProj);
+	FrustumCuller::ExtractPlanes(cameraViewProj, fubo.cameraPlanes);
+	FrustumCuller::ExtractPlanes(shadowViewProj, fubo.shadowPlanes);
+
+	fubo.AmbientColour = Lighting::AmbientColour;
+	fubo.DirectionalColour = Lighting::LightColour;
+
+	//Copy into this frame's block, the ring stays mapped
+	uniformRing.Write(frame, frameBlock, &fubo, sizeof(fubo));
+
+	//Kernel, only re-uploaded after computeKernel has run
+	if (uploadedKernelVersion != subsurfaceManager.kernelVersion)
+	{
+		uploadedKernelVersion = subsurfaceManager.kernelVersion;
+		kernelDirtyFrames = MAX_FRAMES_IN_FLIGHT;
+	}
+	if (kernelDirtyFrames > 0)
+	{
+		KernelUniformBufferObject kubo;
+		for (size_t i = 0; i < MAX_PROFILES * MAX_SAMPLES; i++) kubo.kernel[i] = subsurfaceManager.BlurKernel()[i];
+		for (size_t i = 0; i < MAX_PROFILES * ADAPTIVE_TAPS; i++) kubo.adaptiveKernel[i] = subsurfaceManager.adaptiveKernel[i];
+		for (size_t i = 0; i < ADAPTIVE_TIERS; i++) kubo.adaptiveTiers[i] = subsurfaceManager.adaptiveTiers[i];
+		for (size_t i = 0; i < MAX_PROFILES * BURLEY_SAMPLES; i++) kubo.burleyKernel[i] = subsurfaceManager.burleyKernel[i];
+		uniformRing.Write(frame, kernelBlock, &kubo, sizeof(kubo));
+		kernelDirtyFrames--;
+	}
 
-	ubo.AmbientColour = Lighting::AmbientColour;
-	ubo.AmbientColour.w = m_Objects[objectIndex]->Lit();
-	ubo.DirectionalColour = Lighting::LightColour;
+	//Screen space passes, only change with the swap chain size
+	if (screenPassDirtyFrames > 0)
+	{
+		//SSSS first pass
+		GBubo = {};
+		GBubo.blurDirection = glm::vec2(1, 0); //Blur horizontal
+		uniformRing.Write(frame, GBUniformBlock, &GBubo, sizeof(GBufferUniformBufferObject));
 
-	//Map memory to a CPU side pointer, copy over data then unmap from cpu side
-	void* data;
-	vkMapMemory(device, uniformBuffersMemory[index], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(device, uniformBuffersMemory[index]);
+		//SSSS Second Pass
+		SSubo = {};
+		SSubo.blurDirection = glm::vec2(0, 1);//Blur Verticle
+		uniformRing.Write(frame, subsurfaceManager.SSUniformBlock, &SSubo, sizeof(GBufferUniformBufferObject));
 
-	
-	//Depth MVP
-	offscreenUBOs[objectIndex].depthMVP = depthProjectionMatrix * depthViewMatrix * depthModelMatrix;
+		screenPassDirtyFrames--;
+	}
+}
 
-	void* offdata;
-	vkMapMemory(device, offscreenMemorys[objectIndex], 0, sizeof(OffScreenUniformBufferObject), 0, &offdata);
-	memcpy(offdata, &offscreenUBOs[objectIndex], sizeof(OffScreenUniformBufferObject));
-	vkUnmapMemory(device, offscreenMemorys[objectIndex]);
-	
-	//SSSS first pass
-	GBubo = {};
-	float width = swapChainExtent.width;
-	float height = swapChainExtent.height;
-	glm::mat4 finalM = (glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, 0)) * glm::rotate(glm::radians(0.0f), glm::vec3(0, 1, 0)) * glm::scale(glm::mat4(1.0f), glm::vec3(width/2, height/2, 1)));
-	glm::mat4 finalView = glm::lookAt(glm::vec3(0.0f, 0.001f, 0.55f), glm::vec3(0.0f, 0.001f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+void VulkanApp::updateUniformBuffer(uint32_t frame, unsigned int objectIndex)
+{
+	//Objects spinning over time change every frame, others only when moved
+	if (m_Objects[objectIndex]->ConsumeChanged() || m_Objects[objectIndex]->GetRot().y != 0.0f)
+	{
+		objectDirtyFrames[objectIndex] = MAX_FRAMES_IN_FLIGHT;
 
-	
-	GBubo.proj = glm::ortho<float>(-width /2, width / 2, height / 2, -height / 2, -1.f, 1.f);
-	GBubo.view = finalView;
-	GBubo.model = finalM;
-	for (size_t i = 0; i < SAMPLES; i++) GBubo.kernel[i] = subsurfaceManager.kernel[i];
-	GBubo.blurDirection = glm::vec2(1, 0); //Blur horizontal
-
-	void* gbdata;
-	vkMapMemory(device, GBUniformMemory, 0, sizeof(GBufferUniformBufferObject), 0, &gbdata);
-	memcpy(gbdata, &GBubo, sizeof(GBufferUniformBufferObject));
-	vkUnmapMemory(device, GBUniformMemory);
-
-	//SSSS Second Pass
-	SSubo = {};
-	SSubo.proj = glm::ortho<float>(-width / 2, width / 2, height / 2, -height / 2, -1.f, 1.f);
-	SSubo.view = finalView;
-	SSubo.model = finalM;
-	for (size_t i = 0; i < SAMPLES; i++) SSubo.kernel[i] = subsurfaceManager.kernel[i];
-	SSubo.blurDirection = glm::vec2(0, 1);//Blur Verticle
-
-	void* ssdata;
-	vkMapMemory(device, subsurfaceManager.SSUniformMemory, 0, sizeof(GBufferUniformBufferObject), 0, &ssdata);
-	memcpy(ssdata, &SSubo, sizeof(GBufferUniformBufferObject));
-	vkUnmapMemory(device, subsurfaceManager.SSUniformMemory);
+		//Model matrix (rotation and translation and scale), also used for the shadow pass, time set by updateClock at the start of the frame
+		ObjectData& data = objectData[objectIndex];
+		data.prevModel = data.model;
+		data.model = m_Objects[objectIndex]->GetModelMatrix(realTime);
+		data.lit = glm::vec4(m_Objects[objectIndex]->Lit() ? 1.0f : 0.0f, m_Objects[objectIndex]->Subsurface() ? 1.0f : 0.0f, static_cast<float>(m_Objects[objectIndex]->MaterialID()), 0.0f);
+
+		//Keep the culling bounds in step with the transform, for both the CPU and GPU culling
+		glm::vec3 center, extents;
+		float radius;
+		m_Objects[objectIndex]->GetWorldBounds(data.model, center, extents, radius);
+		objectCuller.SetBounds(objectIndex, center, extents, radius);
+		data.sphere = glm::vec4(center, radius);
+		data.extents = glm::vec4(extents, m_Objects[objectIndex]->CastsShadow() ? 1.0f : 0.0f);
+
+		//Where the culling pre-pass writes the object's draw
+		const MeshRange& mesh = m_Objects[objectIndex]->GetMesh();
+		data.mesh = glm::uvec4(mesh.indexCount, mesh.firstIndex, static_cast<uint32_t>(mesh.vertexOffset), objectSlots[objectIndex]);
+	}
+
+	else if (objectData[objectIndex].prevModel != objectData[objectIndex].model)
+	{
+		//Stopped moving, the previous transform catches up so the object has no motion
+		objectData[objectIndex].prevModel = objectData[objectIndex].model;
+		objectDirtyFrames[objectIndex] = MAX_FRAMES_IN_FLIGHT;
+	}
+
+	//Skip static objects whose data in this frame's region is already up to date
+	if (objectDirtyFrames[objectIndex] == 0)
+		return;
+	objectDirtyFrames[objectIndex]--;
+
+	//Copy into this frame's array, the ring stays mapped
+	uniformRing.Write(frame, objectBlock + objectIndex * sizeof(ObjectData), &objectData[objectIndex], sizeof(ObjectData));
 }
 
-void VulkanApp::createDescriptorPool()
+void VulkanApp::createDrawCommands()
 {
-	unsigned int size = 0;
-	for (unsigned int i = 0; i < m_Objects.size(); i++)
+	objectCuller.Resize(m_Objects.size());
+	cameraVisible.assign(m_Objects.size(), 1);
+	shadowVisible.assign(m_Objects.size(), 1);
+
+	//Give objects sharing a material neighbouring slots, so each material is one indirect call
+	drawBatches.clear();
+	objectSlots.assign(m_Objects.size(), 0);
+	uint32_t slot = 0;
+	for (size_t m = 0; m < m_Materials.size(); m++)
 	{
-		size += swapChainImages.size();
+		DrawBatch batch = { m_Materials[m], slot, 0 };
+		for (size_t j = 0; j < m_Objects.size(); j++)
+		{
+			if (m_Objects[j]->GetMaterial() != m_Materials[m])
+				continue;
+			objectSlots[j] = slot++;
+			batch.count++;
+		}
+		if (batch.count > 0)
+			drawBatches.push_back(batch);
 	}
 
-	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(size*5);
-	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(size*7); //Need additional textures for the shadow map
+	//A region per frame in flight, holding the GBuffer commands then the shadow commands
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 1);
+	drawRegionSize = 2 * m_Objects.size() * sizeof(VkDrawIndexedIndirectCommand);
+	drawRegionSize = (drawRegionSize + alignment - 1) / alignment * alignment;
+
+	//Only ever written by the culling pre-pass, so it can live in device memory
+	m_Engine->createBuffer(drawRegionSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCommandBuffer, drawCommandMemory);
+}
+
+void VulkanApp::cullObjects()
+{
+	//Pre-recorded buffers are culled on the GPU by the culling pre-pass
+	if (!settings.recordEachFrame)
+		return;
+
+	//Buffers recorded each frame leave culled objects out instead
+	objectCuller.Cull(cameraViewProj, cameraVisible);
+	objectCuller.Cull(shadowViewProj, shadowVisible);
+}
+
+VkDeviceSize VulkanApp::drawCommandOffset(uint32_t frame, bool shadow, uint32_t slot) const
+{
+	return frame * drawRegionSize + ((shadow ? m_Objects.size() : 0) + slot) * sizeof(VkDrawIndexedIndirectCommand);
+}
+
+Material* VulkanApp::getMaterial(const char* texturePath, const char* nTexturePath, const char* sTexturePath)
+{
+	std::string key = std::string(texturePath) + '|' + nTexturePath + '|' + sTexturePath;
+
+	auto found = m_MaterialLookup.find(key);
+	if (found != m_MaterialLookup.end())
+		return found->second;
+
+	Material* material = new Material(m_Engine, device, graphicsQueue, commandPool, texturePath, nTexturePath, sTexturePath);
+	m_Materials.push_back(material);
+	m_MaterialLookup[key] = material;
+	return material;
+}
 
+void VulkanApp::createDescriptorPool()
+{
+	//Sets allocated by createDescriptorSets from each layout
+	const uint32_t materialSets = static_cast<uint32_t>(m_Materials.size());
+	//The two screen space passes, the composite, reduced resolution vertical and upsample sets, and a temporal and history composite set per frame in flight
+	const uint32_t screenSets = 5 + 2 * MAX_FRAMES_IN_FLIGHT;
+	const uint32_t lightingSets = 1;
+	const uint32_t frameSets = 1;
+	const uint32_t cullSets = 1;
+	const uint32_t computeSets = 2; //One per blur direction
+	const uint32_t classifySets = subsurfaceManager.tiled ? 1 : 0;
+
+	//Descriptors in each layout, see createDescriptorSetLayout and the subsurface compute pipelines
+	const uint32_t materialSamplers = 4; //Albedo, shadow map, normal and specular textures
+	const uint32_t screenUniforms = 1; //GBuffer pass block
+	const uint32_t screenSamplers = 5; //Colour, depth, history or shadow map, normals, and motion or shadow compare
+	const uint32_t frameUniforms = 2; //Frame and kernel blocks
+	const uint32_t frameStorageBuffers = 1; //Object array
+	const uint32_t cullStorageBuffers = 1; //Draw commands
+	const uint32_t computeSamplers = 4; //Colour, depth, GBuffer colour and material IDs
+	const uint32_t computeStorageImages = 1; //Blur target
+	const uint32_t computeStorageBuffers = 1; //Tile list
+	const uint32_t classifySamplers = 1; //GBuffer colour
+	const uint32_t classifyStorageBuffers = 1; //Tile list
+	//The lighting subpass reads albedo, depth and normals as input attachments, the shadow map and its compare sampler stay samplers
+	const uint32_t lightingInputs = settings.gbufferSubpasses ? 3 : 0;
+	const uint32_t lightingSamplers = screenSamplers - lightingInputs;
+
+	std::array<VkDescriptorPoolSize, 6> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = (screenSets + lightingSets) * screenUniforms + frameSets * frameUniforms;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = materialSets * materialSamplers + screenSets * screenSamplers + lightingSets * lightingSamplers + computeSets * computeSamplers + classifySets * classifySamplers;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSizes[2].descriptorCount = frameSets * frameStorageBuffers + cullSets * cullStorageBuffers;
+	poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[3].descriptorCount = computeSets * computeStorageImages;
+	poolSizes[4].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[4].descriptorCount = computeSets * computeStorageBuffers + classifySets * classifyStorageBuffers;
+	poolSizes[5].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	poolSizes[5].descriptorCount = std::max(lightingSets * lightingInputs, 1u); //Pool sizes cannot be zero
+	uint32_t totalSets = materialSets + screenSets + lightingSets + frameSets + cullSets + computeSets + classifySets;
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(size*2);
+	poolInfo.maxSets = totalSets;
 
 	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create descriptor pool!");
@@ -1793,14 +2798,8 @@ void VulkanApp::createDescriptorPool()
 
 void VulkanApp::createDescriptorSets()
 {
-	unsigned int size = 0;
-	for (unsigned int i = 0; i < m_Objects.size(); i++)
-	{
-		size += swapChainImages.size();
-	}
-
-	//Allocate memory
-	std::vector<VkDescriptorSetLayout> layouts(size, descriptorSetLayout);
+	//One set per material, the object's data is picked by the instance index when drawing
+	std::vector<VkDescriptorSetLayout> layouts(m_Materials.size(), materialSetLayout);
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = descriptorPool; //Pass in the pool
@@ -1811,121 +2810,134 @@ void VulkanApp::createDescriptorSets()
 	
 	
 	//Allocate memory
-	descriptorSets.resize(size);
+	std::vector<VkDescriptorSet> descriptorSets(m_Materials.size());
 	//Allocate desciptor sets 
 	if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate descriptor sets!");
 	}
-	//For each swap chain image set up and pass in the descriptor set and buffer for each image
-	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		for (unsigned int j = 0; j < m_Objects.size(); j++)
-		{
-			unsigned int index = m_Objects.size() * i + j;
-				
-			VkDescriptorBufferInfo bufferInfo = {};
-			bufferInfo.buffer = uniformBuffers[index]; //Actual buffer to use
-			bufferInfo.offset = 0; //Start at the start
-			bufferInfo.range = sizeof(UniformBufferObject); //Size of each buffer
+	//For each material set up and pass in the descriptor set and textures
+	for (unsigned int j = 0; j < m_Materials.size(); j++)
+	{
+		m_Materials[j]->descriptorSet = descriptorSets[j];
 
-			VkDescriptorImageInfo imageInfo = {};
-			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		
-			//std::cout << index << std::endl;
-			imageInfo.imageView = m_Objects[j]->GetTextureImageView();
-			imageInfo.sampler = m_Objects[j]->GetTextureSampler();
-
-			//Pass uniform buffer at binding 0
-			std::array<VkWriteDescriptorSet, 5> descriptorWrites = {};
-			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[0].dstSet = descriptorSets[index]; //desciptor to use
-			descriptorWrites[0].dstBinding = 0;
-			descriptorWrites[0].dstArrayElement = 0;
-			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptorWrites[0].descriptorCount = 1;
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
-				
-			//Pass uniform sampler at binding 1
-			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[1].dstSet = descriptorSets[index];
-			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].descriptorCount = 1;
-			descriptorWrites[1].pImageInfo = &imageInfo;
-
-			VkDescriptorImageInfo imageInfoDepth = {};
-			imageInfoDepth.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-			imageInfoDepth.imageView = offscreenPass.depth.view;// m_Objects[j]->GetTextureImageView();
-			imageInfoDepth.sampler = offscreenPass.depthSampler;//m_Objects[j]->GetTextureSampler();
-			descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[2].dstSet = descriptorSets[index];
-			descriptorWrites[2].dstBinding = 2;
-			descriptorWrites[2].dstArrayElement = 0;
-			descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[2].descriptorCount = 1;
-			descriptorWrites[2].pImageInfo = &imageInfoDepth;
-
-			VkDescriptorImageInfo imageInfoNormal = {};
-			imageInfoNormal.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfoNormal.imageView = m_Objects[j]->GetNormalTextureImageView();
-			imageInfoNormal.sampler = m_Objects[j]->GetNormalTextureSampler();
-			descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[3].dstSet = descriptorSets[index];
-			descriptorWrites[3].dstBinding = 3;
-			descriptorWrites[3].dstArrayElement = 0;
-			descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[3].descriptorCount = 1;
-			descriptorWrites[3].pImageInfo = &imageInfoNormal;
-
-			VkDescriptorImageInfo imageInfoSpec = {};
-			imageInfoSpec.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfoSpec.imageView = m_Objects[j]->GetSpecTextureImageView();
-			imageInfoSpec.sampler = m_Objects[j]->GetSpecTextureSampler();
-			descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[4].dstSet = descriptorSets[index];
-			descriptorWrites[4].dstBinding = 4;
-			descriptorWrites[4].dstArrayElement = 0;
-			descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[4].descriptorCount = 1;
-			descriptorWrites[4].pImageInfo = &imageInfoSpec;
-
-
-
-			//Set the descriptor set for this image
-			vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	
+		imageInfo.imageView = m_Materials[j]->GetTextureImageView();
+		imageInfo.sampler = m_Materials[j]->GetTextureSampler();
+
+		std::array<VkWriteDescriptorSet, 4> descriptorWrites = {};
 			
-		}
+		//Pass uniform sampler at binding 1
+		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[0].dstSet = descriptorSets[j];
+		descriptorWrites[0].dstBinding = 1;
+		descriptorWrites[0].dstArrayElement = 0;
+		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[0].descriptorCount = 1;
+		descriptorWrites[0].pImageInfo = &imageInfo;
+
+		VkDescriptorImageInfo imageInfoDepth = {};
+		imageInfoDepth.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		imageInfoDepth.imageView = offscreenPass.depth.view;// m_Objects[j]->GetTextureImageView();
+		imageInfoDepth.sampler = offscreenPass.depthSampler;//m_Objects[j]->GetTextureSampler();
+		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[1].dstSet = descriptorSets[j];
+		descriptorWrites[1].dstBinding = 2;
+		descriptorWrites[1].dstArrayElement = 0;
+		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[1].descriptorCount = 1;
+		descriptorWrites[1].pImageInfo = &imageInfoDepth;
+
+		VkDescriptorImageInfo imageInfoNormal = {};
+		imageInfoNormal.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfoNormal.imageView = m_Materials[j]->GetNormalTextureImageView();
+		imageInfoNormal.sampler = m_Materials[j]->GetNormalTextureSampler();
+		descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[2].dstSet = descriptorSets[j];
+		descriptorWrites[2].dstBinding = 3;
+		descriptorWrites[2].dstArrayElement = 0;
+		descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[2].descriptorCount = 1;
+		descriptorWrites[2].pImageInfo = &imageInfoNormal;
+
+		VkDescriptorImageInfo imageInfoSpec = {};
+		imageInfoSpec.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfoSpec.imageView = m_Materials[j]->GetSpecTextureImageView();
+		imageInfoSpec.sampler = m_Materials[j]->GetSpecTextureSampler();
+		descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[3].dstSet = descriptorSets[j];
+		descriptorWrites[3].dstBinding = 4;
+		descriptorWrites[3].dstArrayElement = 0;
+		descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[3].descriptorCount = 1;
+		descriptorWrites[3].pImageInfo = &imageInfoSpec;
+
+
+
+		//Set the descriptor set for this material
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		
 	}
 
 
-	//Allocate memory
-	std::vector<VkDescriptorSetLayout> layoutsOff(m_Objects.size(), descriptorSetLayout);
-	VkDescriptorSetAllocateInfo allocInfoOff = {};
-	allocInfoOff.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfoOff.descriptorPool = descriptorPool; //Pass in the pool
-	allocInfoOff.descriptorSetCount = static_cast<uint32_t>(layoutsOff.size()); //Same as pool descriptor count
-	allocInfoOff.pSetLayouts = layoutsOff.data(); //Pass in layout data
-	offscreenDescSets.resize(m_Objects.size());
-	if (vkAllocateDescriptorSets(device, &allocInfoOff, offscreenDescSets.data()) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate offscreen descriptor sets!");
-	}
-	offscreenUBOs.resize(m_Objects.size());
-	for (unsigned int i = 0; i < m_Objects.size(); i++)
-	{
-		VkDescriptorBufferInfo bufferInfoOff = {};
-		bufferInfoOff.buffer = offscreenUniforms[i]; //Actual buffer to use
-		bufferInfoOff.offset = 0; //Start at the start
-		bufferInfoOff.range = sizeof(OffScreenUniformBufferObject);
-		std::array<VkWriteDescriptorSet, 1> descriptorWritesOff = {};
-		descriptorWritesOff[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWritesOff[0].dstSet = offscreenDescSets[i]; //desciptor to use
-		descriptorWritesOff[0].dstBinding = 0;
-		descriptorWritesOff[0].dstArrayElement = 0;
-		descriptorWritesOff[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWritesOff[0].descriptorCount = 1;
-		descriptorWritesOff[0].pBufferInfo = &bufferInfoOff;
-		vkUpdateDescriptorSets(device, descriptorWritesOff.size(), descriptorWritesOff.data(), 0, nullptr);
-	}
+	//Frame set, the frame and kernel blocks and the object array
+	VkDescriptorSetAllocateInfo allocInfoFrame = {};
+	allocInfoFrame.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfoFrame.descriptorPool = descriptorPool; //Pass in the pool
+	allocInfoFrame.descriptorSetCount = 1;
+	allocInfoFrame.pSetLayouts = &frameSetLayout; //Pass in layout data
+	if (vkAllocateDescriptorSets(device, &allocInfoFrame, &frameSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate frame descriptor set!");
+	}
+
+	VkDescriptorBufferInfo bufferInfoFrame = {};
+	bufferInfoFrame.buffer = uniformRing.Buffer(); //Actual buffer to use
+	bufferInfoFrame.offset = 0; //Start of the block is given by the dynamic offset
+	bufferInfoFrame.range = sizeof(FrameUniformBufferObject);
+	VkDescriptorBufferInfo bufferInfoKernel = bufferInfoFrame;
+	bufferInfoKernel.range = sizeof(KernelUniformBufferObject);
+	VkDescriptorBufferInfo bufferInfoObjects = bufferInfoFrame;
+	bufferInfoObjects.range = m_Objects.size() * sizeof(ObjectData);
+
+	std::array<VkWriteDescriptorSet, 3> descriptorWritesFrame = {};
+	descriptorWritesFrame[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWritesFrame[0].dstSet = frameSet; //desciptor to use
+	descriptorWritesFrame[0].dstBinding = 0;
+	descriptorWritesFrame[0].dstArrayElement = 0;
+	descriptorWritesFrame[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWritesFrame[0].descriptorCount = 1;
+	descriptorWritesFrame[0].pBufferInfo = &bufferInfoFrame;
+	descriptorWritesFrame[1] = descriptorWritesFrame[0];
+	descriptorWritesFrame[1].dstBinding = 1;
+	descriptorWritesFrame[1].pBufferInfo = &bufferInfoKernel;
+	descriptorWritesFrame[2] = descriptorWritesFrame[0];
+	descriptorWritesFrame[2].dstBinding = 2;
+	descriptorWritesFrame[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	descriptorWritesFrame[2].pBufferInfo = &bufferInfoObjects;
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWritesFrame.size()), descriptorWritesFrame.data(), 0, nullptr);
+
+	//Culling set, one frame's region of the draw commands
+	VkDescriptorSetAllocateInfo allocInfoCull = allocInfoFrame;
+	allocInfoCull.pSetLayouts = &cullSetLayout;
+	if (vkAllocateDescriptorSets(device, &allocInfoCull, &cullSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate culling descriptor set!");
+	}
+
+	VkDescriptorBufferInfo bufferInfoDraws = {};
+	bufferInfoDraws.buffer = drawCommandBuffer;
+	bufferInfoDraws.offset = 0; //Start of the region is given by the dynamic offset
+	bufferInfoDraws.range = 2 * m_Objects.size() * sizeof(VkDrawIndexedIndirectCommand);
+
+	VkWriteDescriptorSet descriptorWriteCull = {};
+	descriptorWriteCull.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWriteCull.dstSet = cullSet;
+	descriptorWriteCull.dstBinding = 0;
+	descriptorWriteCull.dstArrayElement = 0;
+	descriptorWriteCull.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	descriptorWriteCull.descriptorCount = 1;
+	descriptorWriteCull.pBufferInfo = &bufferInfoDraws;
+	vkUpdateDescriptorSets(device, 1, &descriptorWriteCull, 0, nullptr);
 
 	//Allocate memory
 	std::vector<VkDescriptorSetLayout> layoutsR(1, descriptorSetLayout);
@@ -1940,16 +2952,61 @@ void VulkanApp::createDescriptorSets()
 	if (vkAllocateDescriptorSets(device, &allocInfoR, &subsurfaceManager.finalSSet) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate offscreen descriptor sets!");
 	}
+	if (vkAllocateDescriptorSets(device, &allocInfoR, &subsurfaceManager.compositeSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate offscreen descriptor sets!");
+	}
+	if (vkAllocateDescriptorSets(device, &allocInfoR, &subsurfaceManager.scaledVerticalSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate offscreen descriptor sets!");
+	}
+	if (vkAllocateDescriptorSets(device, &allocInfoR, &subsurfaceManager.upsampleSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate offscreen descriptor sets!");
+	}
+	VkDescriptorSetAllocateInfo allocInfoLighting = allocInfoR;
+	if (settings.gbufferSubpasses)
+		allocInfoLighting.pSetLayouts = &lightingPass.setLayout;
+	if (vkAllocateDescriptorSets(device, &allocInfoLighting, &lightingPass.descriptorSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate lighting descriptor set!");
+	}
+
+	//Temporal blur and history composite sets, one of each per history image
+	std::vector<VkDescriptorSetLayout> layoutsHistory(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+	VkDescriptorSetAllocateInfo allocInfoHistory = allocInfoR;
+	allocInfoHistory.descriptorSetCount = static_cast<uint32_t>(layoutsHistory.size());
+	allocInfoHistory.pSetLayouts = layoutsHistory.data();
+	subsurfaceManager.temporalSets.resize(MAX_FRAMES_IN_FLIGHT);
+	subsurfaceManager.historyCompositeSets.resize(MAX_FRAMES_IN_FLIGHT);
+	if (vkAllocateDescriptorSets(device, &allocInfoHistory, subsurfaceManager.temporalSets.data()) != VK_SUCCESS ||
+		vkAllocateDescriptorSets(device, &allocInfoHistory, subsurfaceManager.historyCompositeSets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate subsurface history descriptor sets!");
+	}
+
+	//Compute blur sets
+	std::array<VkDescriptorSetLayout, 2> layoutsCompute = { subsurfaceManager.computeSetLayout, subsurfaceManager.computeSetLayout };
+	VkDescriptorSetAllocateInfo allocInfoCompute = allocInfoR;
+	allocInfoCompute.descriptorSetCount = static_cast<uint32_t>(layoutsCompute.size());
+	allocInfoCompute.pSetLayouts = layoutsCompute.data();
+	if (vkAllocateDescriptorSets(device, &allocInfoCompute, subsurfaceManager.computeSets) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate subsurface compute descriptor sets!");
+	}
+	if (subsurfaceManager.tiled)
+	{
+		VkDescriptorSetAllocateInfo allocInfoClassify = allocInfoR;
+		allocInfoClassify.descriptorSetCount = 1;
+		allocInfoClassify.pSetLayouts = &subsurfaceManager.classifySetLayout;
+		if (vkAllocateDescriptorSets(device, &allocInfoClassify, &subsurfaceManager.classifySet) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate subsurface classification descriptor set!");
+		}
+	}
 
 	UpdateGBufferSets();
 }
 
 void VulkanApp::createDepthResources()
 {
-	VkFormat depthFormat = findDepthFormat();
+	VkFormat depthFormat = findDepthStencilFormat();
 
-	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory, VK_SAMPLE_COUNT_1_BIT);
-	depthImageView = m_Engine->createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory, VK_SAMPLE_COUNT_1_BIT);
+	depthImageView = m_Engine->createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
 
 	m_Engine->transitionImageLayout(graphicsQueue, commandPool, depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 }
@@ -1980,6 +3037,15 @@ VkFormat VulkanApp::findDepthFormat()
 	);
 }
 
+VkFormat VulkanApp::findDepthStencilFormat()
+{
+	return findSupportedFormat(
+		{ VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+	);
+}
+
 void VulkanApp::prepareOffscreenRenderpass()
 {
 
@@ -2095,6 +3161,16 @@ void VulkanApp::prepareOffscreenFramebuffer()
 	depthSampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 	vkCreateSampler(device, &depthSampler, nullptr, &offscreenPass.depthSampler);
 
+	//Same map with the depth compare done by the sampler, each linear tap then returns the lit fraction of a 2x2 quad.
+	//Nearest filtering still compares, one texel per tap, where the format cannot be filtered
+	VkFormatProperties shadowProps;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_D16_UNORM, &shadowProps);
+	if (!(shadowProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+		depthSampler.magFilter = depthSampler.minFilter = VK_FILTER_NEAREST;
+	depthSampler.compareEnable = VK_TRUE;
+	depthSampler.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	vkCreateSampler(device, &depthSampler, nullptr, &offscreenPass.shadowSampler);
+
 	prepareOffscreenRenderpass();
 
 	//Create frame buffer to store the depth infomation
@@ -2116,6 +3192,14 @@ VkSampleCountFlagBits VulkanApp::getMaxUsableSampleCount()
 	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
 
 	VkSampleCountFlags counts = std::min(physicalDeviceProperties.limits.framebufferColorSampleCounts, physicalDeviceProperties.limits.framebufferDepthSampleCounts);
+
+	//The limits above do not cover integer formats, the GBuffer's are checked on their own
+	for (VkFormat format : { GBUFFER_NORMAL_FORMAT, GBUFFER_DEPTH_FORMAT })
+	{
+		VkImageFormatProperties formatProperties = {};
+		vkGetPhysicalDeviceImageFormatProperties(physicalDevice, format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, 0, &formatProperties);
+		counts &= formatProperties.sampleCounts;
+	}
 	if (counts & VK_SAMPLE_COUNT_64_BIT) { return VK_SAMPLE_COUNT_64_BIT; }
 	if (counts & VK_SAMPLE_COUNT_32_BIT) { return VK_SAMPLE_COUNT_32_BIT; }
 	if (counts & VK_SAMPLE_COUNT_16_BIT) { return VK_SAMPLE_COUNT_16_BIT; }
@@ -2128,29 +3212,35 @@ VkSampleCountFlagBits VulkanApp::getMaxUsableSampleCount()
 
 void VulkanApp::createColorResources()
 {
-	VkFormat colorFormat = swapChainImageFormat;
+	VkFormat colorFormat = subsurfaceManager.ColourFormat(swapChainImageFormat);
 
-	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageMemory, VK_SAMPLE_COUNT_1_BIT);
+	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageMemory, VK_SAMPLE_COUNT_1_BIT);
 	colorImageView = m_Engine->createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT);
 
+	//The lighting subpass reads the resolved normals and depth as input attachments, the subsurface passes still sample them
+	VkImageUsageFlags inputUsage = settings.gbufferSubpasses ? VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT : 0;
+
+	//Resolved albedo, the lighting pass reads it and writes the lit colour into colorImage. As a subpass nothing else reads it, so it never leaves the pass
+	VkImageUsageFlags albedoUsage = settings.gbufferSubpasses ? VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : VK_IMAGE_USAGE_SAMPLED_BIT;
+	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, VK_FORMAT_B8G8R8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | albedoUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, albedoImage, albedoImageMemory, VK_SAMPLE_COUNT_1_BIT);
+	albedoImageView = m_Engine->createImageView(albedoImage, VK_FORMAT_B8G8R8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+
 	//m_Engine->transitionImageLayout(graphicsQueue, commandPool, colorImage, colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 	////////////////
-	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, normalImage, normalImageMemory, VK_SAMPLE_COUNT_1_BIT);
-	normalImageView = m_Engine->createImageView(normalImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
+	//Octahedral normal in rg, lighting flags in b, material ID in the 2 bit alpha
+	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, GBUFFER_NORMAL_FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | inputUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, normalImage, normalImageMemory, VK_SAMPLE_COUNT_1_BIT);
+	normalImageView = m_Engine->createImageView(normalImage, GBUFFER_NORMAL_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
 
 	//m_Engine->transitionImageLayout(graphicsQueue, commandPool, normalImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 	///////////
-	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, posImage, posImageMemory, VK_SAMPLE_COUNT_1_BIT);
-	posImageView = m_Engine->createImageView(posImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
+	//Screen space motion, only the temporal subsurface pass reads it
+	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, motionImage, motionImageMemory, VK_SAMPLE_COUNT_1_BIT);
+	motionImageView = m_Engine->createImageView(motionImage, VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
 
-	//m_Engine->transitionImageLayout(graphicsQueue, commandPool, posImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 	//////////////
-	VkFormat depthFormat = findDepthFormat();
-
-	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, dImage, dImageMemory, VK_SAMPLE_COUNT_1_BIT);
-	dImageView = m_Engine->createImageView(dImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-	//m_Engine->transitionImageLayout(graphicsQueue, commandPool, dImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	//Vulkan 1.0 cannot resolve a multisampled depth buffer, so the depth is also written as a colour and resolved into here
+	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, GBUFFER_DEPTH_FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | inputUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, dImage, dImageMemory, VK_SAMPLE_COUNT_1_BIT);
+	dImageView = m_Engine->createImageView(dImage, GBUFFER_DEPTH_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
 
 	
 }
@@ -2186,7 +3276,7 @@ void VulkanApp::CreateGAttachment(VkFormat format, VkImageUsageFlagBits usage, F
 	image.arrayLayers = 1;
 	image.samples = msaaSamples;
 	image.tiling = VK_IMAGE_TILING_OPTIMAL;
-	image.usage = usage | VK_IMAGE_USAGE_SAMPLED_BIT;
+	image.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT; //Only the resolves are read after the pass, the samples never leave it
 
 	VkMemoryAllocateInfo memAlloc{};
 	memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
@@ -2195,7 +3285,7 @@ void VulkanApp::CreateGAttachment(VkFormat format, VkImageUsageFlagBits usage, F
 	vkCreateImage(device, &image, nullptr, &attachment->image);
 	vkGetImageMemoryRequirements(device, attachment->image, &memReqs);
 	memAlloc.allocationSize = memReqs.size;
-	memAlloc.memoryTypeIndex = m_Engine->findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	memAlloc.memoryTypeIndex = m_Engine->findTransientMemoryType(memReqs.memoryTypeBits);
 	vkAllocateMemory(device, &memAlloc, nullptr, &attachment->mem);
 	vkBindImageMemory(device, attachment->image, attachment->mem, 0);
 
@@ -2217,15 +3307,15 @@ void VulkanApp::prepareGOffscreenFramebuffer()
 {
 	// Color attachments
 
-	// (World space) Positions
+	// Screen space motion, world positions are rebuilt from the depth instead
 	CreateGAttachment(
-		VK_FORMAT_R16G16B16A16_SFLOAT,
+		VK_FORMAT_R16G16_SFLOAT,
 		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-		&offScreenFrameBuf.position);
+		&offScreenFrameBuf.motion);
 
-	// (World space) Normals
+	// (World space) Normals, octahedral encoded with the lighting flags in b and the material ID in alpha
 	CreateGAttachment(
-		VK_FORMAT_R16G16B16A16_SFLOAT,
+		GBUFFER_NORMAL_FORMAT,
 		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
 		&offScreenFrameBuf.normal);
 
@@ -2235,6 +3325,12 @@ void VulkanApp::prepareGOffscreenFramebuffer()
 		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
 		&offScreenFrameBuf.albedo);
 
+	// Depth as a colour, resolved into dImage
+	CreateGAttachment(
+		GBUFFER_DEPTH_FORMAT,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+		&offScreenFrameBuf.depthCopy);
+
 	// Depth attachment
 
 	// Find a suitable depth format
@@ -2248,14 +3344,15 @@ void VulkanApp::prepareGOffscreenFramebuffer()
 	// Set up separate renderpass with references
 	// to the color and depth attachments
 
-	std::array<VkAttachmentDescription, 8> attachmentDescs = {};
+	//With subpasses the lit colour is attachment 9, written by the lighting subpass
+	std::vector<VkAttachmentDescription> attachmentDescs(settings.gbufferSubpasses ? 10 : 9);
 
-	// Init attachment properties
+	// Init attachment properties, the samples are only needed until they are resolved so they are never stored
 	for (uint32_t i = 0; i < 4; ++i)
 	{
 		attachmentDescs[i].samples = msaaSamples;
 		attachmentDescs[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachmentDescs[i].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		attachmentDescs[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		attachmentDescs[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		if (i == 3)
@@ -2266,20 +3363,25 @@ void VulkanApp::prepareGOffscreenFramebuffer()
 		else
 		{
 			attachmentDescs[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			attachmentDescs[i].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 		}
 	}
 
+	//The multisampled depth copy comes after the resolves
+	attachmentDescs[8] = attachmentDescs[0];
+
 	// Formats
-	attachmentDescs[0].format = offScreenFrameBuf.position.format;
+	attachmentDescs[0].format = offScreenFrameBuf.motion.format;
 	attachmentDescs[1].format = offScreenFrameBuf.normal.format;
 	attachmentDescs[2].format = offScreenFrameBuf.albedo.format;
 	attachmentDescs[3].format = offScreenFrameBuf.depth.format;
+	attachmentDescs[8].format = offScreenFrameBuf.depthCopy.format;
 
 	std::vector<VkAttachmentReference> colorReferences;
 	colorReferences.push_back({ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
 	colorReferences.push_back({ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
 	colorReferences.push_back({ 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+	colorReferences.push_back({ 8, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
 
 	VkAttachmentReference depthReference = {};
 	depthReference.attachment = 3;
@@ -2287,32 +3389,13 @@ void VulkanApp::prepareGOffscreenFramebuffer()
 
 
 	VkAttachmentDescription colorAttachmentResolve = {};
-	colorAttachmentResolve.format = offScreenFrameBuf.position.format;
 	colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
 	colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-	VkAttachmentDescription albedoAttachmentResolve = {};
-	albedoAttachmentResolve.format = offScreenFrameBuf.albedo.format;
-	albedoAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-	albedoAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	albedoAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	albedoAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	albedoAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	albedoAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	albedoAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-	VkAttachmentDescription depthAttachmentResolve = {};
-	depthAttachmentResolve.format = offScreenFrameBuf.depth.format;
-	depthAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-	depthAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	depthAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	depthAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	depthAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; //Sampled by the lighting and subsurface passes
 
 	VkAttachmentReference colorAttachmentResolveRef = {};
 	colorAttachmentResolveRef.attachment = 4;
@@ -2325,23 +3408,28 @@ void VulkanApp::prepareGOffscreenFramebuffer()
 	colorAttachmentResolveRef3.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	VkAttachmentReference colorAttachmentResolveRef4 = {};
 	colorAttachmentResolveRef4.attachment = 7;
-	colorAttachmentResolveRef4.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	colorAttachmentResolveRef4.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	//Each resolve matches the format of the target it resolves
 	attachmentDescs[4] = colorAttachmentResolve;
+	attachmentDescs[4].format = offScreenFrameBuf.motion.format;
 	attachmentDescs[5] = colorAttachmentResolve;
-	attachmentDescs[6] = albedoAttachmentResolve;
-	attachmentDescs[7] = depthAttachmentResolve;
+	attachmentDescs[5].format = offScreenFrameBuf.normal.format;
+	attachmentDescs[6] = colorAttachmentResolve;
+	attachmentDescs[6].format = offScreenFrameBuf.albedo.format;
+	attachmentDescs[7] = colorAttachmentResolve;
+	attachmentDescs[7].format = offScreenFrameBuf.depthCopy.format;
 
 	std::array<VkAttachmentReference, 4> refs = { colorAttachmentResolveRef,colorAttachmentResolveRef2,colorAttachmentResolveRef3,colorAttachmentResolveRef4 };
-	VkSubpassDescription subpass = {};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.pColorAttachments = colorReferences.data();
-	subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
-	subpass.pDepthStencilAttachment = &depthReference;
-	subpass.pResolveAttachments = refs.data();
+	std::vector<VkSubpassDescription> subpasses(settings.gbufferSubpasses ? 2 : 1);
+	subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpasses[0].pColorAttachments = colorReferences.data();
+	subpasses[0].colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+	subpasses[0].pDepthStencilAttachment = &depthReference;
+	subpasses[0].pResolveAttachments = refs.data();
 
 	// Use subpass dependencies for attachment layput transitions
-	std::array<VkSubpassDependency, 2> dependencies;
+	std::vector<VkSubpassDependency> dependencies(2);
 
 	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 	dependencies[0].dstSubpass = 0;
@@ -2359,26 +3447,76 @@ void VulkanApp::prepareGOffscreenFramebuffer()
 	dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
 	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+	//Lighting subpass, reads this pixel of the resolved albedo, depth and normals as input attachments and writes the lit colour.
+	//The albedo is not needed after it, so it is neither stored nor given real memory where the driver can avoid it
+	std::array<VkAttachmentReference, 3> inputReferences = {};
+	VkAttachmentReference litReference = { 9, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	if (settings.gbufferSubpasses)
+	{
+		inputReferences[0] = { 6, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		inputReferences[1] = { 7, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		inputReferences[2] = { 5, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		attachmentDescs[6].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+		attachmentDescs[9] = colorAttachmentResolve;
+		attachmentDescs[9].format = subsurfaceManager.ColourFormat(swapChainImageFormat);
+
+		subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpasses[1].inputAttachmentCount = static_cast<uint32_t>(inputReferences.size());
+		subpasses[1].pInputAttachments = inputReferences.data();
+		subpasses[1].colorAttachmentCount = 1;
+		subpasses[1].pColorAttachments = &litReference;
+
+		//The resolves are written at the end of the first subpass, each lighting pixel only reads its own
+		VkSubpassDependency inputDependency = {};
+		inputDependency.srcSubpass = 0;
+		inputDependency.dstSubpass = 1;
+		inputDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		inputDependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		inputDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		inputDependency.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+		inputDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+		dependencies.push_back(inputDependency);
+
+		//Either blur samples around each pixel of the lit colour, depth and normals, so this is not by region
+		VkSubpassDependency litDependency = {};
+		litDependency.srcSubpass = 1;
+		litDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+		litDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		litDependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		litDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		litDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		litDependency.dependencyFlags = 0;
+		dependencies.push_back(litDependency);
+		dependencies[1].dstStageMask = litDependency.dstStageMask;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[1].dependencyFlags = 0;
+	}
+
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassInfo.pAttachments = attachmentDescs.data();
 	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachmentDescs.size());
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 2;
+	renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+	renderPassInfo.pSubpasses = subpasses.data();
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
 	renderPassInfo.pDependencies = dependencies.data();
 
 	vkCreateRenderPass(device, &renderPassInfo, nullptr, &offScreenFrameBuf.renderPass);
 
-	std::array<VkImageView, 8> attachments;
-	attachments[0] = offScreenFrameBuf.position.view;
+	std::vector<VkImageView> attachments(attachmentDescs.size());
+	attachments[0] = offScreenFrameBuf.motion.view;
 	attachments[1] = offScreenFrameBuf.normal.view;
 	attachments[2] = offScreenFrameBuf.albedo.view;
 	attachments[3] = offScreenFrameBuf.depth.view;
-	attachments[4] = posImageView;
+	attachments[4] = motionImageView;
 	attachments[5] = normalImageView;
-	attachments[6] = colorImageView;
+	attachments[6] = albedoImageView;
 	attachments[7] = dImageView;
+	attachments[8] = offScreenFrameBuf.depthCopy.view;
+	if (settings.gbufferSubpasses)
+		attachments[9] = colorImageView;
 
 	VkFramebufferCreateInfo fbufCreateInfo = {};
 	fbufCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -2395,8 +3533,9 @@ void VulkanApp::prepareGOffscreenFramebuffer()
 	VkSamplerCreateInfo sampler{};
 	sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	sampler.maxAnisotropy = 1.0f;
-	sampler.magFilter = VK_FILTER_NEAREST;
-	sampler.minFilter = VK_FILTER_NEAREST;
+	//Merged kernel taps sit between pixels and rely on the filtering to blend them, the other passes sample at pixel centres
+	sampler.magFilter = subsurfaceManager.mergeTaps ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+	sampler.minFilter = subsurfaceManager.mergeTaps ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
 	sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
 	sampler.addressModeV = sampler.addressModeU;
@@ -2412,6 +3551,83 @@ void VulkanApp::prepareGOffscreenFramebuffer()
 	
 }
 
+void VulkanApp::prepareLightingFramebuffer()
+{
+	//Drawn in the GBuffer render pass instead
+	if (settings.gbufferSubpasses)
+	{
+		lightingPass.renderPass = VK_NULL_HANDLE;
+		lightingPass.frameBuffer = VK_NULL_HANDLE;
+		return;
+	}
+
+	//Every pixel is written by the fullscreen triangle, so the old contents are not loaded
+	VkAttachmentDescription colorAttachment = {};
+	colorAttachment.format = subsurfaceManager.ColourFormat(swapChainImageFormat);
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; //Sampled by the subsurface passes
+
+	VkAttachmentReference colorAttachmentRef = {};
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentRef;
+
+	std::array<VkSubpassDependency, 2> dependencies;
+
+	//Reads the resolved GBuffer
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	//Either blur samples around each pixel, so this is not by region
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	dependencies[1].dependencyFlags = 0;
+
+	VkRenderPassCreateInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &colorAttachment;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
+
+	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &lightingPass.renderPass) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create lighting render pass!");
+	}
+
+	VkFramebufferCreateInfo framebufferInfo = {};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = lightingPass.renderPass;
+	framebufferInfo.attachmentCount = 1;
+	framebufferInfo.pAttachments = &colorImageView;
+	framebufferInfo.width = swapChainExtent.width;
+	framebufferInfo.height = swapChainExtent.height;
+	framebufferInfo.layers = 1;
+
+	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &lightingPass.frameBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create lighting framebuffer!");
+	}
+}
+
 void VulkanApp::CleanGBuffer()
 {
 	//Clean up single samplesv
@@ -2419,22 +3635,30 @@ void VulkanApp::CleanGBuffer()
 	vkDestroyImage(device, colorImage, nullptr);
 	vkFreeMemory(device, colorImageMemory, nullptr);
 
+	vkDestroyImageView(device, albedoImageView, nullptr);
+	vkDestroyImage(device, albedoImage, nullptr);
+	vkFreeMemory(device, albedoImageMemory, nullptr);
+
 	vkDestroyImageView(device, normalImageView, nullptr);
 	vkDestroyImage(device, normalImage, nullptr);
 	vkFreeMemory(device, normalImageMemory, nullptr);
 
-	vkDestroyImageView(device, posImageView, nullptr);
-	vkDestroyImage(device, posImage, nullptr);
-	vkFreeMemory(device, posImageMemory, nullptr);
+	vkDestroyImageView(device, motionImageView, nullptr);
+	vkDestroyImage(device, motionImage, nullptr);
+	vkFreeMemory(device, motionImageMemory, nullptr);
 
 	vkDestroyImageView(device, dImageView, nullptr);
 	vkDestroyImage(device, dImage, nullptr);
 	vkFreeMemory(device, dImageMemory, nullptr);
 
 	// Color attachments
-	vkDestroyImageView(device, offScreenFrameBuf.position.view, nullptr);
-	vkDestroyImage(device, offScreenFrameBuf.position.image, nullptr);
-	vkFreeMemory(device, offScreenFrameBuf.position.mem, nullptr);
+	vkDestroyImageView(device, offScreenFrameBuf.motion.view, nullptr);
+	vkDestroyImage(device, offScreenFrameBuf.motion.image, nullptr);
+	vkFreeMemory(device, offScreenFrameBuf.motion.mem, nullptr);
+
+	vkDestroyImageView(device, offScreenFrameBuf.depthCopy.view, nullptr);
+	vkDestroyImage(device, offScreenFrameBuf.depthCopy.image, nullptr);
+	vkFreeMemory(device, offScreenFrameBuf.depthCopy.mem, nullptr);
 
 	vkDestroyImageView(device, offScreenFrameBuf.normal.view, nullptr);
 	vkDestroyImage(device, offScreenFrameBuf.normal.image, nullptr);
@@ -2454,30 +3678,33 @@ void VulkanApp::CleanGBuffer()
 	vkDestroyFramebuffer(device, offScreenFrameBuf.frameBuffer, nullptr);
 	vkDestroyRenderPass(device, offScreenFrameBuf.renderPass, nullptr);
 
+	vkDestroyFramebuffer(device, lightingPass.frameBuffer, nullptr);
+	vkDestroyRenderPass(device, lightingPass.renderPass, nullptr);
+
 	vkDestroyPipeline(device, graphicsPipeline, nullptr);
 }
 
 void VulkanApp::UpdateGBufferSets()
 {
 	VkDescriptorBufferInfo bufferInfo = {};
-	bufferInfo.buffer = GBUniform; //Actual buffer to use
-	bufferInfo.offset = 0; //Start at the start
+	bufferInfo.buffer = uniformRing.Buffer(); //Actual buffer to use
+	bufferInfo.offset = 0; //Start of the block is given by the dynamic offset
 	bufferInfo.range = sizeof(GBufferUniformBufferObject); //Size of each buffer
 
 	VkDescriptorImageInfo imageInfo = {};
-	imageInfo.imageLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 	//std::cout << index << std::endl;
 	imageInfo.imageView = colorImageView;
 	imageInfo.sampler = colourSampler;
 
 	//Pass uniform buffer at binding 0
-	std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+	std::array<VkWriteDescriptorSet, 4> descriptorWrites = {};
 	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	descriptorWrites[0].dstSet = finalRSet; //desciptor to use
 	descriptorWrites[0].dstBinding = 0;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorWrites[0].descriptorCount = 1;
 	descriptorWrites[0].pBufferInfo = &bufferInfo;
 
@@ -2491,17 +3718,30 @@ void VulkanApp::UpdateGBufferSets()
 	descriptorWrites[1].pImageInfo = &imageInfo;
 
 
-	VkDescriptorImageInfo imageInfoNorm = {};
-	imageInfoNorm.imageLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-	imageInfoNorm.imageView = normalImageView;
-	imageInfoNorm.sampler = colourSampler;
+	VkDescriptorImageInfo imageInfoDepth = {};
+	imageInfoDepth.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfoDepth.imageView = dImageView;
+	imageInfoDepth.sampler = colourSampler;
 	descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	descriptorWrites[2].dstSet = finalRSet;
 	descriptorWrites[2].dstBinding = 2;
 	descriptorWrites[2].dstArrayElement = 0;
 	descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	descriptorWrites[2].descriptorCount = 1;
-	descriptorWrites[2].pImageInfo = &imageInfoNorm;
+	descriptorWrites[2].pImageInfo = &imageInfoDepth;
+
+	//Material ID in the alpha of the normals, picks the blur's diffusion profile
+	VkDescriptorImageInfo imageInfoNorm = {};
+	imageInfoNorm.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfoNorm.imageView = normalImageView;
+	imageInfoNorm.sampler = colourSampler;
+	descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[3].dstSet = finalRSet;
+	descriptorWrites[3].dstBinding = 4;
+	descriptorWrites[3].dstArrayElement = 0;
+	descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[3].descriptorCount = 1;
+	descriptorWrites[3].pImageInfo = &imageInfoNorm;
 
 
 	vkUpdateDescriptorSets(device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
@@ -2509,44 +3749,97 @@ void VulkanApp::UpdateGBufferSets()
 	descriptorWrites[0].dstSet = subsurfaceManager.finalSSet;
 	descriptorWrites[1].dstSet = subsurfaceManager.finalSSet;
 	descriptorWrites[2].dstSet = subsurfaceManager.finalSSet;
+	descriptorWrites[3].dstSet = subsurfaceManager.finalSSet;
 
 	imageInfo.imageView = subsurfaceManager.SSImageView;
 	descriptorWrites[1].pImageInfo = &imageInfo;
-	bufferInfo.buffer = subsurfaceManager.SSUniform;
-	descriptorWrites[0].pBufferInfo = &bufferInfo;
 	
 	vkUpdateDescriptorSets(device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+
+	//Lighting pass, the resolved albedo, depth and normals with the shadow map at binding 3, and again through the compare sampler at 5
+	VkDescriptorImageInfo imageInfoAlbedo = imageInfo;
+	imageInfoAlbedo.imageView = albedoImageView;
+	VkDescriptorImageInfo imageInfoShadow = {};
+	imageInfoShadow.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	imageInfoShadow.imageView = offscreenPass.depth.view;
+	imageInfoShadow.sampler = offscreenPass.depthSampler;
+	VkDescriptorImageInfo imageInfoShadowCompare = imageInfoShadow;
+	imageInfoShadowCompare.sampler = offscreenPass.shadowSampler;
+	std::array<VkWriteDescriptorSet, 6> lightingWrites = {};
+	std::copy(descriptorWrites.begin(), descriptorWrites.end(), lightingWrites.begin());
+	lightingWrites[4] = descriptorWrites[3];
+	lightingWrites[5] = descriptorWrites[3];
+	for (size_t i = 0; i < lightingWrites.size(); i++)
+		lightingWrites[i].dstSet = lightingPass.descriptorSet;
+	lightingWrites[1].pImageInfo = &imageInfoAlbedo;
+	lightingWrites[4].dstBinding = 3;
+	lightingWrites[4].pImageInfo = &imageInfoShadow;
+	lightingWrites[5].dstBinding = 5;
+	lightingWrites[5].pImageInfo = &imageInfoShadowCompare;
+	//As a subpass the GBuffer is read as input attachments, which have no sampler
+	if (settings.gbufferSubpasses)
+	{
+		for (int i = 1; i < 4; i++)
+			lightingWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	}
+
+	vkUpdateDescriptorSets(device, lightingWrites.size(), lightingWrites.data(), 0, nullptr);
+
+	//Compute blur and its composite pass
+	subsurfaceManager.UpdateComputeSets(device, colorImageView, dImageView, normalImageView, colourSampler, uniformRing.Buffer(), sizeof(GBufferUniformBufferObject));
+	//Reduced resolution blur and its upsample
+	subsurfaceManager.UpdateScaledSets(device, colorImageView, dImageView, normalImageView, colourSampler, uniformRing.Buffer(), sizeof(GBufferUniformBufferObject));
+	//Temporal blur and the copy of its history
+	subsurfaceManager.UpdateHistorySets(device, subsurfaceManager.SSImageView, dImageView, normalImageView, motionImageView, colourSampler, uniformRing.Buffer(), sizeof(GBufferUniformBufferObject));
 }
 
 void VulkanApp::CreateSSFrameBuffer()
 {
 	//SS
-	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, subsurfaceManager.SSImage, subsurfaceManager.SSImageMemory, VK_SAMPLE_COUNT_1_BIT);
-	subsurfaceManager.SSImageView = m_Engine->createImageView(subsurfaceManager.SSImage, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+	//Holds the horizontal result, with the packed depth when the vertical pass reads it from here
+	VkFormat SSFormat = subsurfaceManager.ColourFormat(swapChainImageFormat);
+	m_Engine->createImage(swapChainExtent.width, swapChainExtent.height, SSFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, subsurfaceManager.SSImage, subsurfaceManager.SSImageMemory, VK_SAMPLE_COUNT_1_BIT);
+	subsurfaceManager.SSImageView = m_Engine->createImageView(subsurfaceManager.SSImage, SSFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+	subsurfaceManager.CreateComputeTargets(m_Engine, swapChainExtent);
 	subsurfaceManager.computeKernel();
 
 	//Render Pass
 	VkAttachmentDescription colorAttachment = {};
-	colorAttachment.format = swapChainImageFormat;
+	colorAttachment.format = SSFormat;
 	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT; //Colour attachment must match swap chain format
 	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; //Clear after frame
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; //Store frame-buffer after render so we can use it later
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; //Not using stencil buffer for this
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; //Not using stencil buffer for this
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;  //Ignore previos layout
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; //Use image in the swap buffer
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; //Sampled by the final pass
+
+	//Stencil marks the pixels that skip the blur, it is kept for the final pass
+	VkAttachmentDescription stencilAttachment = {};
+	stencilAttachment.format = findDepthStencilFormat();
+	stencilAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	stencilAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	stencilAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	stencilAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	stencilAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+	stencilAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	stencilAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	//Refrence to the attachment for the sub passes
 	VkAttachmentReference colorAttachmentRef = {};
 	colorAttachmentRef.attachment = 0;
 	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	VkAttachmentReference stencilAttachmentRef = {};
+	stencilAttachmentRef.attachment = 1;
+	stencilAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	//Sub pass info
 	VkSubpassDescription subpass = {};
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS; //Tell the pass that this is a graphics pass, not a compute pass
 	subpass.colorAttachmentCount = 1; //Just one attachment for colour rendering
 	subpass.pColorAttachments = &colorAttachmentRef; //Pass reference
+	subpass.pDepthStencilAttachment = &stencilAttachmentRef;
 
 	std::array<VkSubpassDependency, 2> dependencies;
 
@@ -2558,17 +3851,18 @@ void VulkanApp::CreateSSFrameBuffer()
 	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+	//The final pass samples the colour and tests the stencil
 	dependencies[1].srcSubpass = 0;
 	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
 	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 
 	std::array<VkSubpassDescription, 1> subpasses = { subpass };
-	std::array<VkAttachmentDescription, 1> passAttachments = { colorAttachment };//, colorAttachmentResolve };
+	std::array<VkAttachmentDescription, 2> passAttachments = { colorAttachment, stencilAttachment };
 	//Set up the final render pass info passing in the above data
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -2583,11 +3877,19 @@ void VulkanApp::CreateSSFrameBuffer()
 	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &subsurfaceManager.SSRenderPass) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create render pass!");
 	}
-	//For each swap chain view create a frame buffer
 
-	std::array<VkImageView, 1> attachments = {
-			subsurfaceManager.SSImageView
+	//Compatible pass that keeps the stencil, for the reduced resolution vertical blur
+	stencilAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	stencilAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	passAttachments[1] = stencilAttachment;
+	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &subsurfaceManager.SSLoadRenderPass) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create render pass!");
+	}
+	//For each swap chain view create a frame buffer
 
+	std::array<VkImageView, 2> attachments = {
+			subsurfaceManager.SSImageView,
+			depthImageView
 	};
 
 	VkFramebufferCreateInfo framebufferInfo = {};
@@ -2603,6 +3905,12 @@ void VulkanApp::CreateSSFrameBuffer()
 	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &subsurfaceManager.SSFrameBuffer) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create framebuffer!");
 	}
+
+	if (subsurfaceManager.resolutionScale > 1)
+		subsurfaceManager.CreateScaledTargets(m_Engine, device, swapChainExtent, swapChainImageFormat, findDepthStencilFormat());
+	//Recreated with the swap chain, the old history no longer matches the screen
+	if (subsurfaceManager.temporalPhases > 1)
+		subsurfaceManager.CreateHistoryTargets(m_Engine, device, graphicsQueue, commandPool, swapChainExtent, MAX_FRAMES_IN_FLIGHT, depthImageView, findDepthStencilFormat());
 	
 
 
@@ -20,6 +20,21 @@ uint32_t VulkanEngine::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags
 	throw std::runtime_error("failed to find suitable memory type!");
 }
 
+uint32_t VulkanEngine::findTransientMemoryType(uint32_t typeFilter)
+{
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(m_PhyDevice, &memProperties);
+
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+			return i;
+		}
+	}
+
+	//Desktop drivers rarely offer it, the attachment is then ordinary device memory
+	return findMemoryType(typeFilter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
 void VulkanEngine::createBuffer(VkDeviceSize size, 
 	VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, VkDeviceMemory & bufferMemory)
 {
@@ -101,62 +116,30 @@ void VulkanEngine::endSingleTimeCommands(VkQueue& graphicsQueue, VkCommandPool&
 	vkFreeCommandBuffers(m_Device, comPool, 1, &commandBuffer);
 }
 
-void VulkanEngine::createVertexBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VulkanObject* object)
+void VulkanEngine::createDeviceLocalBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, const void* source, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
 {
-	//Calculate buffer size
-	VkDeviceSize bufferSize = sizeof(Vertex) * object->GetVertices().size();
-
-
 	//Use our create buffer function to get a generic staging buffer buffer
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
-	//Map the memory to a CPU side pointer and copy over the vertex data
+	//Map the memory to a CPU side pointer and copy over the data
 	void* data;
 	vkMapMemory(m_Device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, object->GetVertices().data(), (size_t)bufferSize);
+	memcpy(data, source, (size_t)bufferSize);
 	vkUnmapMemory(m_Device, stagingBufferMemory); //Unmap from cpu side
 
-												  //Create a vertex buffer
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, object->GetVertexBuffer(), object->GetVertexMemory());
+	//Create the device local buffer
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
 
-	//Copy the staging buffer data to the vertex buffer
-	copyBuffer(graphicsQueue, comPool, stagingBuffer, object->GetVertexBuffer(), bufferSize);
+	//Copy the staging buffer data to the new buffer
+	copyBuffer(graphicsQueue, comPool, stagingBuffer, buffer, bufferSize);
 
 	//Destroy the staging buffer and free memory
 	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
 	vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
 }
 
-void VulkanEngine::createIndexBuffer(VkQueue& graphicsQueue, VkCommandPool& comPool, VulkanObject* object)
-{
-	//Calculate buffer size
-	VkDeviceSize bufferSize = sizeof(object->GetIndices()[0]) * object->GetIndices().size();
-
-	//Set up staging buffer
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	//Map the data to  CPU side pointer and copy over the data, then unmap
-	void* data;
-	vkMapMemory(m_Device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, object->GetIndices().data(), (size_t)bufferSize);
-	vkUnmapMemory(m_Device, stagingBufferMemory);
-
-	//Create the index buffer
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, object->GetIndexBuffer(), object->GetIndexMemory());
-
-	//Copy the data from the staging buffer to the new index buffer
-	copyBuffer(graphicsQueue, comPool, stagingBuffer, object->GetIndexBuffer(), bufferSize);
-
-
-	//Clean up the staging buffer
-	vkDestroyBuffer(m_Device, stagingBuffer, nullptr);
-	vkFreeMemory(m_Device, stagingBufferMemory, nullptr);
-}
-
 void VulkanEngine::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & imageMemory, VkSampleCountFlagBits numSamples)
 {
 	VkImageCreateInfo imageInfo = {};
@@ -184,7 +167,7 @@ void VulkanEngine::createImage(uint32_t width, uint32_t height, VkFormat format,
 	VkMemoryAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+	allocInfo.memoryTypeIndex = (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) ? findTransientMemoryType(memRequirements.memoryTypeBits) : findMemoryType(memRequirements.memoryTypeBits, properties);
 
 	if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate image memory!");
@@ -329,6 +312,12 @@ void VulkanEngine::transitionImageLayout(VkQueue& graphicsQueue, VkCommandPool&
 		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	}
+	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
 	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
 		barrier.srcAccessMask = 0;
 		barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
@@ -1,57 +1,21 @@
 #include "VulkanObject.h"
 
-#include "VulkanEngine.h"
+#include "GeometryArena.h"
+
+#include <algorithm>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h> 
 
-VulkanObject::VulkanObject(VulkanEngine* engine, VkDevice& device, VkQueue graphicsQueue, VkCommandPool commandPool, const char* modelPath, const char* texturePath, const char* nTexturePath, const char* sTexturePath) : m_Device(device)
+VulkanObject::VulkanObject(GeometryArena* arena, const char* modelPath, Material* material)
 {
-	m_Engine = engine;
+	m_Material = material;
 
 	loadModel(modelPath);
 
-	m_Engine->createVertexBuffer(graphicsQueue, commandPool, this);
-	m_Engine->createIndexBuffer(graphicsQueue, commandPool, this);
-
-	m_Engine->createTextureImage(graphicsQueue, commandPool, textureImage, textureImageMemory, texturePath);
-	m_Engine->createTextureImageView(this, textureImageView, textureImage);
-	m_Engine->createTextureSampler(this, textureSampler);
-
-	m_Engine->createTextureImage(graphicsQueue, commandPool, ntextureImage, ntextureImageMemory, nTexturePath);
-	m_Engine->createTextureImageView(this, ntextureImageView, ntextureImage);
-	m_Engine->createTextureSampler(this, ntextureSampler);
-
-	m_Engine->createTextureImage(graphicsQueue, commandPool, stextureImage, stextureImageMemory, sTexturePath);
-	m_Engine->createTextureImageView(this, stextureImageView, stextureImage);
-	m_Engine->createTextureSampler(this, stextureSampler);
-}
-VulkanObject::~VulkanObject()
-{
-
-	//Clean up index buffer
-	vkDestroyBuffer(m_Device, m_IndexBuffer, nullptr);
-	vkFreeMemory(m_Device, m_IndexBufferMemory, nullptr);
-
-	//clean up vertex buffer
-	vkDestroyBuffer(m_Device, m_VertexBuffer, nullptr);
-	vkFreeMemory(m_Device, m_VertexBufferMemory, nullptr);
-
-	//Cleanup Texture
-	vkDestroyImage(m_Device, textureImage, nullptr);
-	vkDestroyImageView(m_Device, textureImageView, nullptr);
-	vkDestroySampler(m_Device, textureSampler, nullptr);
-	vkFreeMemory(m_Device, textureImageMemory, nullptr);
-
-	vkDestroyImage(m_Device, ntextureImage, nullptr);
-	vkDestroyImageView(m_Device, ntextureImageView, nullptr);
-	vkDestroySampler(m_Device, ntextureSampler, nullptr);
-	vkFreeMemory(m_Device, ntextureImageMemory, nullptr);
-
-	vkDestroyImage(m_Device, stextureImage, nullptr);
-	vkDestroyImageView(m_Device, stextureImageView, nullptr);
-	vkDestroySampler(m_Device, stextureSampler, nullptr);
-	vkFreeMemory(m_Device, stextureImageMemory, nullptr);
-
+	//The arena keeps the mesh from here on
+	m_Mesh = arena->Add(vertices, indices);
+	vertices = std::vector<Vertex>();
+	indices = std::vector<uint32_t>();
 }
 
 void VulkanObject::loadModel(const char * path)
@@ -96,6 +60,44 @@ void VulkanObject::loadModel(const char * path)
 			indices.push_back(uniqueVertices[vertex]);
 		}
 	}
+
+	//Box around every vertex, then the sphere around the box centre that reaches the furthest vertex
+	if (vertices.empty())
+		return;
+	glm::vec3 minimum = vertices[0].pos;
+	glm::vec3 maximum = vertices[0].pos;
+	for (const auto& vertex : vertices) {
+		minimum = glm::min(minimum, vertex.pos);
+		maximum = glm::max(maximum, vertex.pos);
+	}
+	m_BoundsCenter = (minimum + maximum) * 0.5f;
+	m_BoundsExtents = (maximum - minimum) * 0.5f;
+
+	float radiusSquared = 0.0f;
+	for (const auto& vertex : vertices) {
+		glm::vec3 offset = vertex.pos - m_BoundsCenter;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	m_BoundsRadius = sqrt(radiusSquared);
+}
+
+glm::mat4 VulkanObject::GetModelMatrix(float time) const
+{
+	return glm::translate(glm::mat4(1.0f), m_Position) * glm::rotate(glm::mat4(1.0f), time * glm::radians(m_Rotation.y), glm::vec3(0, 1, 0)) * glm::scale(glm::mat4(1.0f), m_Scale);
+}
+
+void VulkanObject::GetWorldBounds(const glm::mat4& model, glm::vec3& center, glm::vec3& extents, float& radius) const
+{
+	center = glm::vec3(model * glm::vec4(m_BoundsCenter, 1.0f));
+
+	//Each world axis reaches as far as the absolute model axes allow
+	glm::mat3 axes = glm::mat3(model);
+	for (int i = 0; i < 3; i++)
+		extents[i] = abs(axes[0][i]) * m_BoundsExtents.x + abs(axes[1][i]) * m_BoundsExtents.y + abs(axes[2][i]) * m_BoundsExtents.z;
+
+	//Scale the sphere by the largest axis scale
+	float scale = std::max(glm::length(axes[0]), std::max(glm::length(axes[1]), glm::length(axes[2])));
+	radius = m_BoundsRadius * scale;
 }
 
 
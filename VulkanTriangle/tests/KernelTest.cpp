@@ -0,0 +1,50 @@
+#include <SubsurfacePass.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+//Merged bilinear kernel test, runs on the CPU without a window or Vulkan device.
+//Every tap count SetSampleCount accepts is paired with PairMergedTaps and each profile measured with MergedKernelError against MERGE_TOLERANCE.
+//With the shipped profiles the merged kernel of at least one is over the tolerance at 9 to 15 and 19 taps, the blur then silently
+//falls back to every tap for all of them. Those counts are expected to fail the bound and to fall back, the rest to pass it and keep their merged taps.
+struct MergeCase
+{
+	uint32_t sampleCount;
+	uint32_t mergedCount; //Taps after pairing, 0 if the merged kernel is over the tolerance
+};
+
+static const MergeCase cases[] = {
+	{ 3, 3 }, { 5, 5 }, { 7, 7 }, //Too few taps for any two to be close enough to pair
+	{ 9, 0 }, { 11, 0 }, { 13, 0 }, { 15, 0 },
+	{ 17, 9 },
+	{ 19, 0 },
+	{ 21, 11 }, { 23, 13 }, { 25, 13 }
+};
+
+int main() {
+	int failures = 0;
+	SubsurfacePass pass;
+
+	for (const MergeCase& test : cases)
+	{
+		//SetSampleCount builds the merged kernel with its fallback, pairing again measures the merged kernel itself
+		pass.SetSampleCount(test.sampleCount);
+		uint32_t blurTaps = pass.mergedCount;
+		pass.PairMergedTaps();
+		float error = 0.0f; //Worst profile, they share the tap count
+		for (uint32_t profile = 0; profile < MAX_PROFILES; profile++)
+			error = std::max(error, pass.MergedKernelError(profile));
+
+		bool fallsBack = test.mergedCount == 0;
+		bool passed = fallsBack
+			? error > MERGE_TOLERANCE && blurTaps == test.sampleCount
+			: error <= MERGE_TOLERANCE && pass.mergedCount == test.mergedCount && blurTaps == test.mergedCount;
+
+		std::cout << test.sampleCount << " taps: merged " << pass.mergedCount << ", error " << error << (fallsBack ? ", falls back to " : ", blurs with ") << blurTaps << " taps" << (passed ? "" : " FAILED") << std::endl;
+		if (!passed)
+			failures++;
+	}
+
+	std::cout << (failures == 0 ? "All merged kernels as expected" : "Merged kernel test failed") << " (tolerance " << MERGE_TOLERANCE << ")" << std::endl;
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}